@@ -0,0 +1,43 @@
+#!/usr/bin/env python
+
+"""
+Script to convert a legacy data file (one byte plus newline per
+address, as written by fill_eeprom.py) to the binary image format
+described in eeprom_device.h: a 64 byte header followed by the raw
+device contents.
+
+usage: convert_eeprom.py [src] [dst] [page_size_bytes]
+"""
+import struct
+import sys
+
+MAGIC       = b"EEPB"
+VERSION     = 1
+HEADER_SIZE = 64
+
+def crc32c(data):
+    crc = 0xFFFFFFFF
+    for byte in bytearray(data):
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+    return crc ^ 0xFFFFFFFF
+
+src       = sys.argv[1] if len(sys.argv) > 1 else 'eeprom.dat'
+dst       = sys.argv[2] if len(sys.argv) > 2 else 'eeprom.bin'
+page_size = int(sys.argv[3]) if len(sys.argv) > 3 else 32
+
+with open(src, 'rb') as file:
+    lines = file.read()
+if len(lines) == 0 or len(lines) % 2 or lines[1::2].strip(b"\n"):
+    sys.exit("%s is not a legacy image" % src)
+contents = lines[0::2]
+
+#magic, version, header_size, size_words, page_size_bytes,
+#word_size_bits, reserved, then crc32c of all of the above
+header = struct.pack("<4sHHIII40x", MAGIC, VERSION, HEADER_SIZE,
+                     len(contents), page_size, 8)
+header += struct.pack("<I", crc32c(header))
+
+with open(dst, 'wb') as file:
+    file.write(header + contents)
@@ -0,0 +1,145 @@
+/* crc32c.c
+ *
+ * Justin S. Selig
+ * Hardware Tier
+ */
+
+#include "crc32c.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#define CRC32C_POLY 0x82F63B78 //reflected Castagnoli polynomial
+
+//slicing-by-8 tables: table[k][b] is the crc of byte b followed
+//by k zero bytes
+static uint32_t       table[8][256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+//crc32c implementation chosen on first use
+static uint32_t (*crc32c_impl)(uint32_t, const uint8_t*, size_t);
+
+//----------------------------------------------------------
+// build_tables
+//
+// Fills slicing-by-8 tables, run once.
+//----------------------------------------------------------
+static void build_tables(void)
+{
+    uint32_t b;
+    int      k;
+    for (b = 0; b < 256; b++)
+    {
+        uint32_t crc = b;
+        for (k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        }
+        table[0][b] = crc;
+    }
+    for (b = 0; b < 256; b++)
+    {
+        for (k = 1; k < 8; k++)
+        {
+            table[k][b] = (table[k-1][b] >> 8) ^ table[0][table[k-1][b] & 0xFF];
+        }
+    }
+}
+
+//----------------------------------------------------------
+// crc32c_sw
+//
+// Portable slicing-by-8, eight bytes per step through eight
+// table lookups. Input and output are not inverted.
+//----------------------------------------------------------
+// @param[in]  : crc - running checksum
+// @param[in]  : p   - data
+// @param[in]  : len - number of bytes
+// @param[out] : uint32_t - updated checksum
+//
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len >= 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc; //little endian
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+              table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^
+              table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+        p   += 8;
+        len -= 8;
+    }
+    while (len--)
+    {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+//----------------------------------------------------------
+// crc32c_hw
+//
+// SSE4.2 crc32 instruction, eight bytes per instruction. Only
+// selected when the CPU reports SSE4.2.
+//----------------------------------------------------------
+// @param[in]  : crc - running checksum
+// @param[in]  : p   - data
+// @param[in]  : len - number of bytes
+// @param[out] : uint32_t - updated checksum
+//
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t c = crc;
+    while (len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c    = __builtin_ia32_crc32di(c, word);
+        p   += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--)
+    {
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+//----------------------------------------------------------
+// select_impl
+//
+// Picks the fastest implementation the CPU supports, run once.
+//----------------------------------------------------------
+static void select_impl(void)
+{
+    build_tables();
+    crc32c_impl = crc32c_sw;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_impl = crc32c_hw;
+    }
+#endif
+}
+
+//Public specification in header
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&table_once, select_impl);
+    return ~crc32c_impl(~crc, buf, len);
+}
+
+//Public specification in header
+uint32_t crc32c_portable(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&table_once, select_impl);
+    return ~crc32c_sw(~crc, buf, len);
+}
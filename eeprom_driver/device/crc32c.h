@@ -0,0 +1,43 @@
+/* crc32c.h
+ *
+ * Justin S. Selig
+ * Hardware Tier
+ */
+
+#ifndef _crc32c_h
+#define _crc32c_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+//----------------------------------------------------------
+// crc32c
+//
+// CRC-32C (Castagnoli) of len bytes of buf, continuing from a
+// previous result crc. Start a new checksum with crc = 0. Uses
+// the SSE4.2 crc32 instruction when the CPU has it, otherwise
+// slicing-by-8 tables.
+//----------------------------------------------------------
+// @param[in]  : crc - running checksum
+// @param[in]  : buf - data
+// @param[in]  : len - number of bytes
+// @param[out] : uint32_t - updated checksum
+//
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+
+//----------------------------------------------------------
+// crc32c_portable
+//
+// crc32c always computed with slicing-by-8 tables, for checking
+// the hardware path against.
+//----------------------------------------------------------
+// @param[in]  : crc - running checksum
+// @param[in]  : buf - data
+// @param[in]  : len - number of bytes
+// @param[out] : uint32_t - updated checksum
+//
+uint32_t crc32c_portable(uint32_t crc, const void *buf, size_t len);
+
+
+#endif
@@ -5,148 +5,1933 @@
  */
 
 #include "eeprom_device.h"
+#include "crc32c.h"
 
-#define LINE_LEN 3
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <libgen.h>
+#include <time.h>
+
+#define LINE_LEN    2   //legacy: one data byte followed by '\n'
+#define CHUNK_LINES 256 //legacy lines staged per positioned read/write
+
+//I2C framing, in SCL clocks
+#define I2C_BYTE_CLOCKS 9 //8 data bits then ACK
+#define I2C_COND_CLOCKS 1 //start, repeated start or stop condition
+#define I2C_ADDR_BYTES  2 //word address bytes after control byte
+
+//EEPROM_DEVICE_TIMED bus, a 24C64 on a fast-mode bus
+#define TIMED_CLOCK_HZ       400000
+#define TIMED_WRITE_CYCLE_US 5000
+
+_Static_assert(sizeof(eeprom_image_header_t) == EEPROM_IMAGE_HEADER,
+    "binary image header layout");
+
+//Backend behind every transaction on an open image, chosen once
+//by eeprom_device_open from the image format and requested
+//backend. Calls are untimed; the bus timing model runs around
+//them, see eeprom_device_set_timing.
+typedef struct device_ops
+{
+    const char *name;
+
+    //copy len bytes out of / into the image at line_num, range checked
+    int (*read_range)(eeprom_device_t *hw, int line_num, char *buf, int len);
+    int (*write_page)(eeprom_device_t *hw, int line_num, const char *buf, int len);
+
+    //start writeback of stored pages / wait until they are durable
+    int (*flush)(eeprom_device_t *hw);
+    int (*sync)(eeprom_device_t *hw);
+
+    //release backend resources, the image descriptor excepted
+    void (*close)(eeprom_device_t *hw);
+
+} device_ops_t;
+
+//Open device image, one per backing file
+struct eeprom_device
+{
+    //registry key, image file identity
+    dev_t st_dev;
+    ino_t st_ino;
+
+    //references held through eeprom_device_open
+    int refs;
+
+    //RAM shadow kept of the image, see eeprom_device_claim_shadow;
+    //changed under registry_lock
+    const void *shadow_owner;
+    int         shadow_refs;
+
+    int   fd;
+    int   lines;    //addressable bytes
+    int   backend;
+    int   format;
+    long  base;     //file offset of address 0
+    int   page;     //page size from header, 0 if unknown
+    char *map;      //EEPROM_DEVICE_MMAP only
+    char *ram;      //EEPROM_DEVICE_RAM contents, lines bytes
+
+    //backend, positioned i/o by format until open completes
+    const device_ops_t *ops;
+    long  size;     //bytes of image file in use
+
+    //write-ahead journal, fd opened on first use
+    pthread_mutex_t journal_lock;
+    char           *journal_path;
+    int             journal_fd;
+    int             journal_pending; //record not yet retired
+    char           *journal_undo;    //prior contents while held, see journal_save
+    int             journal_undo_count;
+
+    //bus timing model, clock_hz zero when disabled
+    pthread_mutex_t bus_lock;
+    uint32_t        clock_hz;
+    uint64_t        write_cycle_ns;
+    uint64_t        busy_until; //end of current tWR, monotonic ns
+    int             bank_lines; //addresses per bank, 0 for one part
+    uint64_t       *bank_busy;  //busy_until of every bank
+
+    //per-page crc32c, NULL until eeprom_device_enable_crc
+    pthread_mutex_t crc_lock;
+    char           *crc_path;
+    uint32_t       *crc;
+    int             crc_page;
+    int             crc_saved; //table file still matches image
+
+    //odd while a page write is being stored, see eeprom_device_generation
+    uint64_t gen;
+
+    //injected transaction failures, see eeprom_device_inject_fault
+    pthread_mutex_t fault_lock;
+    int             fault_skip;  //transactions to pass first
+    int             fault_count; //transactions then failed
+    int             fault_error;
+
+    struct eeprom_device *next;
+};
+
+//Journal record header, followed by count journal_extent_t then
+//the data of every extent in order
+typedef struct journal_header
+{
+    char     magic[4];
+    uint32_t count;
+    uint32_t bytes;   //record bytes following this header
+    uint32_t crc;     //crc32c of fields above then remaining record
+
+} journal_header_t;
+
+typedef struct journal_extent
+{
+    int32_t line_num;
+    int32_t len;
+
+} journal_extent_t;
+
+//Saved page checksum table header, followed by pages uint32_t
+typedef struct crc_header
+{
+    char     magic[4];
+    uint32_t page_size;
+    uint32_t pages;
+    uint32_t crc;     //crc32c of fields above then table
+
+} crc_header_t;
+
+//registry of open devices, lock held only while opening/closing
+static pthread_mutex_t  registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static eeprom_device_t *registry      = NULL;
 
 //----------------------------------------------------------
-// get_num_lines
+// header_crc
 //
-// Helper function for checking that writes remain within bounds.
-// Returns total number of lines in file file_name.
+// Checksum stored in and checked against header_crc.
 //----------------------------------------------------------
-// @param[in]  : line_num - file line number indexed at 0
-// @param[in]  : new_char - char (byte) to write
-// @param[out] : int      - 0 on success
+// @param[in]  : hdr - binary image header
+// @param[out] : uint32_t - crc32c of fields before header_crc
+//
+static uint32_t header_crc(const eeprom_image_header_t *hdr)
+{
+    return crc32c(0, hdr, offsetof(eeprom_image_header_t, header_crc));
+}
+
+//----------------------------------------------------------
+// validate_binary
+//
+// Checks binary image header against file size.
+//----------------------------------------------------------
+// @param[in]  : hdr  - header read from start of file
+// @param[in]  : size - file size in bytes
+// @param[out] : int  - number of addresses, negative on error
+//
+static int validate_binary(const eeprom_image_header_t *hdr, off_t size)
+{
+    if (hdr->version != EEPROM_IMAGE_VERSION)
+    {
+        printf("Bad device image: version %i\n", hdr->version);
+        return -EINVAL;
+    }
+    if (hdr->header_crc != header_crc(hdr))
+    {
+        printf("Bad device image: header checksum\n");
+        return -EINVAL;
+    }
+    if ((hdr->header_size < sizeof(eeprom_image_header_t)) ||
+        (hdr->size_words == 0) ||
+        (size < (off_t)hdr->header_size + hdr->size_words))
+    {
+        printf("Bad device image: geometry\n");
+        return -EINVAL;
+    }
+    return hdr->size_words;
+}
+
+//----------------------------------------------------------
+// validate_legacy
+//
+// Checks that legacy image holds whole fixed width lines, each
+// terminated by '\n'.
+//----------------------------------------------------------
+// @param[in]  : fd   - open image file descriptor
+// @param[in]  : size - file size in bytes
+// @param[out] : int  - number of lines, negative on error
 //
-int get_num_lines(char *file_name)
+static int validate_legacy(int fd, off_t size)
 {
-    FILE *fp = fopen(file_name, "r");
-    if (fp == NULL)
+    if ((size == 0) || (size % LINE_LEN))
+    {
+        printf("Bad device image: size %li\n", (long)size);
+        return -EINVAL;
+    }
+
+    char *image = malloc(size);
+    if (image == NULL)
     {
-        printf("Failed to open device\n");
+        return -ENOMEM;
+    }
+    if (pread(fd, image, size, 0) != size)
+    {
+        printf("Unable to read device image\n");
+        free(image);
         return -EIO;
     }
-    int  result = 0;
-    char ch;
-    //iterate through whole file
-    while(!feof(fp))
+    //every line ends in a newline, data byte itself may be anything
+    off_t i;
+    for (i = LINE_LEN-1; i < size; i += LINE_LEN)
     {
-        ch = fgetc(fp);
-        //increment for each new line character encountered
-        if(ch == '\n')
+        if (image[i] != '\n')
         {
-            result++;
+            printf("Bad device image: line %li\n", (long)(i/LINE_LEN));
+            free(image);
+            return -EINVAL;
         }
     }
-    fclose(fp);
-    return result;
+    free(image);
+    return size / LINE_LEN;
 }
 
-//Public specification in header
-int eeprom_device_write(int line_num, char new_char)
+//----------------------------------------------------------
+// validate_image
+//
+// Helper function run once when device is opened. Detects the
+// image format, validates it and records its layout in hw.
+//----------------------------------------------------------
+// @param[in]  : hw  - device being opened, fd set
+// @param[in]  : st  - stat of image file
+// @param[out] : int - number of addresses, negative on error
+//
+static int validate_image(eeprom_device_t *hw, const struct stat *st)
 {
-    //check that write to line_num is allowed (within file)
-    int num_file_lines = get_num_lines(DEVICE_FILE_NAME);
-    if (num_file_lines < 0)
+    const int fd = hw->fd;
+
+    eeprom_image_header_t hdr;
+    if ((st->st_size >= sizeof(hdr)) &&
+        (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) &&
+        !memcmp(hdr.magic, EEPROM_IMAGE_MAGIC, sizeof(hdr.magic)))
     {
-        printf("Unable to get num file lines\n");
-        return -EIO;
+        int words = validate_binary(&hdr, st->st_size);
+        if (words >= 0)
+        {
+            hw->format = EEPROM_FORMAT_BINARY;
+            hw->base   = hdr.header_size;
+            hw->page   = hdr.page_size_bytes;
+            hw->size   = hdr.header_size + (long)words;
+        }
+        return words;
     }
-    if (line_num > num_file_lines-1) //zero indexed
+
+    int lines = validate_legacy(fd, st->st_size);
+    if (lines >= 0)
     {
-        printf("Bad address: out of bounds\n");
-        return -EFAULT;
+        hw->format = EEPROM_FORMAT_LEGACY;
+        hw->base   = 0;
+        hw->page   = 0;
+        hw->size   = (long)lines*LINE_LEN;
     }
+    return lines;
+}
 
-    //open eeprom data file for reading
-    FILE *fd1 = fopen(DEVICE_FILE_NAME, "r");
-    if (fd1 == NULL)
+//----------------------------------------------------------
+// check_range
+//
+// Helper function for checking that a transaction stays within
+// the open device image.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : len      - number of lines accessed
+// @param[out] : int      - 0 on success
+//
+static int check_range(eeprom_device_t *hw, int line_num, int len)
+{
+    if (hw == NULL)
     {
-        printf("Failed to open file\n");
-        return -EIO;
+        printf("Device not open\n");
+        return -ENODEV;
+    }
+    //zero indexed, last line accessed is line_num+len-1
+    if ((line_num < 0) || (len < 0) || (line_num > hw->lines-len))
+    {
+        printf("Bad address: out of bounds\n");
+        return -EFAULT;
     }
+    return 0;
+}
 
-    //create a temporary file for writing old data and inserted datum
-    char *temp = "device/temp.dat";
-    FILE *fd2 = fopen(temp, "wb"); //write byte mode
-    if (fd2 == NULL)
+//----------------------------------------------------------
+// legacy_read
+//
+// EEPROM_FORMAT_LEGACY positioned read: whole lines are read a
+// chunk at a time and the data byte kept from each.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - destination buffer of at least len bytes
+// @param[in]  : len      - number of bytes to read
+// @param[out] : int      - 0 on success
+//
+static int legacy_read(eeprom_device_t *hw, int line_num, char *buf, int len)
+{
+    //read whole lines, keep data byte in first column of each
+    char lines[CHUNK_LINES*LINE_LEN];
+    int  done = 0;
+    while (done < len)
     {
-        printf("Failed to open file\n");
-        return -EIO;
+        int n = (len-done > CHUNK_LINES) ? CHUNK_LINES : len-done;
+        int i;
+        off_t pos = (off_t)(line_num+done)*LINE_LEN;
+        if (pread(hw->fd, lines, n*LINE_LEN, pos) != n*LINE_LEN)
+        {
+            printf("out of bounds read\n");
+            return -EFAULT;
+        }
+        for (i = 0; i < n; i++)
+        {
+            buf[done+i] = lines[i*LINE_LEN];
+        }
+        done += n;
     }
 
-    //iterate through old file and copy contents to temp file with
-    //user specified line replaced
-    char str[LINE_LEN];
-    int count = 0;
-    while (!feof(fd1) && (count < num_file_lines))
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// legacy_write
+//
+// EEPROM_FORMAT_LEGACY positioned write: data bytes are
+// interleaved with their newlines and each chunk of lines is
+// stored with one positioned write.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - bytes to write
+// @param[in]  : len      - number of bytes to write
+// @param[out] : int      - 0 on success
+//
+static int legacy_write(eeprom_device_t *hw, int line_num, const char *buf, int len)
+{
+    char lines[CHUNK_LINES*LINE_LEN];
+    int  done = 0;
+    while (done < len)
     {
-        fgets(str, LINE_LEN, fd1);
-        if (count != line_num)
+        int n = (len-done > CHUNK_LINES) ? CHUNK_LINES : len-done;
+        int i;
+        for (i = 0; i < n; i++)
         {
-            fprintf(fd2, "%s", str); //keep str on line count
+            lines[i*LINE_LEN]   = buf[done+i];
+            lines[i*LINE_LEN+1] = '\n';
         }
-        else //found line to replace
+        off_t pos = (off_t)(line_num+done)*LINE_LEN;
+        if (pwrite(hw->fd, lines, n*LINE_LEN, pos) != n*LINE_LEN)
         {
-            fprintf(fd2, "%c\n", new_char); //replace str with new_char on line count
+            printf("Failed to write file\n");
+            return -EIO;
         }
-        count++;
+        done += n;
     }
 
-    fclose(fd1);
-    fclose(fd2);
-    //delete old file, swap for new one
-    remove(DEVICE_FILE_NAME); //temp file is now the primary
-    rename(temp, DEVICE_FILE_NAME); //replace old file with new
+    return 0; //success
+}
 
+//----------------------------------------------------------
+// binary_read
+//
+// EEPROM_FORMAT_BINARY positioned read, contents are raw.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - destination buffer of at least len bytes
+// @param[in]  : len      - number of bytes to read
+// @param[out] : int      - 0 on success
+//
+static int binary_read(eeprom_device_t *hw, int line_num, char *buf, int len)
+{
+    if (pread(hw->fd, buf, len, hw->base + line_num) != len)
+    {
+        printf("out of bounds read\n");
+        return -EFAULT;
+    }
     return 0; //success
 }
 
-//Public specification in header
-int eeprom_device_read(int line_num, char *char_read)
+//----------------------------------------------------------
+// binary_write
+//
+// EEPROM_FORMAT_BINARY positioned write, one per page.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - bytes to write
+// @param[in]  : len      - number of bytes to write
+// @param[out] : int      - 0 on success
+//
+static int binary_write(eeprom_device_t *hw, int line_num, const char *buf, int len)
+{
+    if (pwrite(hw->fd, buf, len, hw->base + line_num) != len)
+    {
+        printf("Failed to write file\n");
+        return -EIO;
+    }
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// file_flush
+//
+// Positioned writes are in the page cache once they return.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+static int file_flush(eeprom_device_t *hw)
 {
-    line_num++; //change indexing of line_num to comply with writes
+    return 0; //success
+}
 
-    //check that read from line_num is allowed
-    int num_file_lines = get_num_lines(DEVICE_FILE_NAME);
-    if (num_file_lines < 0)
+//----------------------------------------------------------
+// file_sync
+//
+// Makes every positioned write issued so far durable.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+static int file_sync(eeprom_device_t *hw)
+{
+    if (fdatasync(hw->fd) < 0)
     {
-        printf("Unable to get num file lines\n");
+        printf("Failed to sync device image\n");
         return -EIO;
     }
-    if (line_num > num_file_lines-1) //zero indexed
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// file_close
+//
+// Positioned i/o holds nothing beyond the image descriptor.
+//----------------------------------------------------------
+// @param[in]  : hw - device handle
+//
+static void file_close(eeprom_device_t *hw)
+{
+}
+
+//----------------------------------------------------------
+// map_read
+//
+// EEPROM_DEVICE_MMAP read, copied out of the mapping.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - destination buffer of at least len bytes
+// @param[in]  : len      - number of bytes to read
+// @param[out] : int      - 0 on success
+//
+static int map_read(eeprom_device_t *hw, int line_num, char *buf, int len)
+{
+    if (hw->format == EEPROM_FORMAT_BINARY)
     {
-        printf("Bad address: out of bounds\n");
-        return -EFAULT;
+        memcpy(buf, hw->map + hw->base + line_num, len);
+        return 0; //success
     }
 
-    //open file to read
-    FILE *fd = fopen(DEVICE_FILE_NAME, "r");
-    if (fd == NULL)
+    //data byte located in first column of each mapped line
+    const char *src = hw->map + (long)line_num*LINE_LEN;
+    int i;
+    for (i = 0; i < len; i++)
     {
-        printf("Failed to open file\n");
-        return -EIO;
+        buf[i] = src[i*LINE_LEN];
     }
+    return 0; //success
+}
 
-    //iterate through file line by line
-    char str[LINE_LEN];
-    int count = 0;
-    do
+//----------------------------------------------------------
+// map_write
+//
+// EEPROM_DEVICE_MMAP page write. Stores data bytes in place in
+// the mapping and flushes only the system pages covering the
+// written bytes.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - bytes to write
+// @param[in]  : len      - number of bytes to write
+// @param[out] : int      - 0 on success
+//
+static int map_write(eeprom_device_t *hw, int line_num, const char *buf, int len)
+{
+    long start;
+    long end;
+    if (hw->format == EEPROM_FORMAT_BINARY)
     {
-        //break when correct line found
-        if (++count == line_num)
+        start = hw->base + line_num;
+        end   = start + len;
+        memcpy(hw->map + start, buf, len);
+    }
+    else
+    {
+        start = (long)line_num*LINE_LEN;
+        end   = (long)(line_num+len)*LINE_LEN;
+        char *dst = hw->map + start;
+        int   i;
+        for (i = 0; i < len; i++)
         {
-            fgets(str, LINE_LEN, fd);
-            break; //str will contain associate byte at line_num
+            dst[i*LINE_LEN] = buf[i];
         }
-    } while((fscanf(fd, "%*[^\n]"), fscanf(fd, "%*c")) != EOF);
-    fclose(fd);
-    //error if count happened to go outside desired line location
-    if (count != line_num)
+    }
+
+    //msync requires a system page aligned start address
+    const long sys_page = sysconf(_SC_PAGESIZE);
+    start = (start / sys_page) * sys_page;
+    if (msync(hw->map + start, end - start, MS_ASYNC) < 0)
     {
-        printf("out of bounds read\n");
-        return -EFAULT;
+        printf("Failed to sync device mapping\n");
+        return -EIO;
     }
-    *char_read = str[0]; //character located in first index of string
-    return 0;
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// map_flush
+//
+// Starts writeback of the whole mapping without waiting.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+static int map_flush(eeprom_device_t *hw)
+{
+    if (msync(hw->map, hw->size, MS_ASYNC) < 0)
+    {
+        printf("Failed to sync device mapping\n");
+        return -EIO;
+    }
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// map_sync
+//
+// Makes every store to the mapping durable.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+static int map_sync(eeprom_device_t *hw)
+{
+    if (msync(hw->map, hw->size, MS_SYNC) < 0)
+    {
+        printf("Failed to sync device image\n");
+        return -EIO;
+    }
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// map_close
+//
+// Removes the image mapping.
+//----------------------------------------------------------
+// @param[in]  : hw - device handle
+//
+static void map_close(eeprom_device_t *hw)
+{
+    munmap(hw->map, hw->size);
+}
+
+//----------------------------------------------------------
+// ram_read
+//
+// EEPROM_DEVICE_RAM read, copied out of the in-memory contents.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - destination buffer of at least len bytes
+// @param[in]  : len      - number of bytes to read
+// @param[out] : int      - 0 on success
+//
+static int ram_read(eeprom_device_t *hw, int line_num, char *buf, int len)
+{
+    memcpy(buf, hw->ram + line_num, len);
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// ram_write
+//
+// EEPROM_DEVICE_RAM write, never reaches the image file.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - bytes to write
+// @param[in]  : len      - number of bytes to write
+// @param[out] : int      - 0 on success
+//
+static int ram_write(eeprom_device_t *hw, int line_num, const char *buf, int len)
+{
+    memcpy(hw->ram + line_num, buf, len);
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// ram_sync
+//
+// Nothing to make durable, used for flush and sync.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+static int ram_sync(eeprom_device_t *hw)
+{
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// ram_close
+//
+// Discards the in-memory contents.
+//----------------------------------------------------------
+// @param[in]  : hw - device handle
+//
+static void ram_close(eeprom_device_t *hw)
+{
+    free(hw->ram);
+}
+
+//backend tables, see device_ops_t
+static const device_ops_t legacy_ops = {
+    "legacy", legacy_read, legacy_write, file_flush, file_sync, file_close };
+static const device_ops_t binary_ops = {
+    "binary", binary_read, binary_write, file_flush, file_sync, file_close };
+static const device_ops_t map_ops = {
+    "mmap", map_read, map_write, map_flush, map_sync, map_close };
+static const device_ops_t ram_ops = {
+    "ram", ram_read, ram_write, ram_sync, ram_sync, ram_close };
+
+//----------------------------------------------------------
+// range_crc
+//
+// Checksums bytes of the image, untimed.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : len      - number of bytes
+// @param[in]  : crc      - receives crc32c of the bytes
+// @param[out] : int      - 0 on success
+//
+static int range_crc(eeprom_device_t *hw, int line_num, int len, uint32_t *crc)
+{
+    char buf[CHUNK_LINES*LINE_LEN];
+    int  done = 0;
+    *crc = 0;
+    while (done < len)
+    {
+        int n = (len-done > (int)sizeof(buf)) ? (int)sizeof(buf) : len-done;
+        int e = hw->ops->read_range(hw, line_num+done, buf, n);
+        if (e < 0)
+        {
+            return e;
+        }
+        *crc = crc32c(*crc, buf, n);
+        done += n;
+    }
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// crc_update
+//
+// Recomputes the checksum of every page touched by a store. A
+// page the store covered whole is checksummed from the bytes
+// just stored; only partly written pages are read back. The
+// saved table stops matching the image, so it is removed before
+// the first change after it was loaded.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - bytes stored
+// @param[in]  : len      - number of bytes stored
+// @param[out] : int      - 0 on success
+//
+static int crc_update(eeprom_device_t *hw, int line_num, const char *buf, int len)
+{
+    int e = 0;
+    int p;
+    pthread_mutex_lock(&hw->crc_lock);
+    if (hw->crc_saved)
+    {
+        unlink(hw->crc_path);
+        hw->crc_saved = 0;
+    }
+    for (p = line_num / hw->crc_page;
+         (len > 0) && (p <= (line_num+len-1) / hw->crc_page) && (e == 0); p++)
+    {
+        int start = p*hw->crc_page;
+        int n     = (hw->lines-start < hw->crc_page) ? hw->lines-start : hw->crc_page;
+        if ((start >= line_num) && (start + n <= line_num + len))
+        {
+            hw->crc[p] = crc32c(0, buf + (start - line_num), n);
+        }
+        else
+        {
+            e = range_crc(hw, start, n, &hw->crc[p]);
+        }
+    }
+    pthread_mutex_unlock(&hw->crc_lock);
+    return e;
+}
+
+//----------------------------------------------------------
+// store_page
+//
+// Stores a page write through the backend, untimed, keeping the page
+// checksums current when they are tracked. The image generation
+// is odd while the bytes are being stored.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, range checked
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - bytes to write
+// @param[in]  : len      - number of bytes to write
+// @param[out] : int      - 0 on success
+//
+static int store_page(eeprom_device_t *hw, int line_num, const char *buf, int len)
+{
+    __atomic_fetch_add(&hw->gen, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    int e = hw->ops->write_page(hw, line_num, buf, len);
+    __atomic_fetch_add(&hw->gen, 1, __ATOMIC_RELEASE);
+    if ((e == 0) && (hw->crc != NULL))
+    {
+        e = crc_update(hw, line_num, buf, len);
+    }
+    return e;
+}
+
+//----------------------------------------------------------
+// crc_load
+//
+// Reads the page checksums saved by the last clean close of
+// the image, if they describe the same geometry.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle, crc allocated
+// @param[out] : int - 0 on success, negative when none usable
+//
+static int crc_load(eeprom_device_t *hw)
+{
+    crc_header_t hdr;
+    const int    pages = (hw->lines + hw->crc_page - 1) / hw->crc_page;
+    const size_t bytes = (size_t)pages*sizeof(uint32_t);
+    int          e     = -ENOENT;
+    int          fd    = open(hw->crc_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return e;
+    }
+    if ((pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) &&
+        !memcmp(hdr.magic, CRC_MAGIC, sizeof(hdr.magic)) &&
+        (hdr.page_size == (uint32_t)hw->crc_page) &&
+        (hdr.pages == (uint32_t)pages) &&
+        (pread(fd, hw->crc, bytes, sizeof(hdr)) == (ssize_t)bytes) &&
+        (crc32c(crc32c(0, &hdr, offsetof(crc_header_t, crc)), hw->crc, bytes) == hdr.crc))
+    {
+        e = 0;
+    }
+    close(fd);
+    return e;
+}
+
+//----------------------------------------------------------
+// crc_save
+//
+// Writes the page checksums beside the image so the next open
+// can check contents against them without recomputing.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle, crc allocated
+// @param[out] : int - 0 on success
+//
+static int crc_save(eeprom_device_t *hw)
+{
+    crc_header_t hdr;
+    const int    pages = (hw->lines + hw->crc_page - 1) / hw->crc_page;
+    const size_t bytes = (size_t)pages*sizeof(uint32_t);
+    memcpy(hdr.magic, CRC_MAGIC, sizeof(hdr.magic));
+    hdr.page_size = hw->crc_page;
+    hdr.pages     = pages;
+    hdr.crc       = crc32c(crc32c(0, &hdr, offsetof(crc_header_t, crc)), hw->crc, bytes);
+
+    int fd = open(hw->crc_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -EIO;
+    }
+    int e = 0;
+    if ((pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+        (pwrite(fd, hw->crc, bytes, sizeof(hdr)) != (ssize_t)bytes))
+    {
+        printf("Failed to save device checksums\n");
+        e = -EIO;
+    }
+    close(fd);
+    if (e < 0)
+    {
+        unlink(hw->crc_path);
+    }
+    return e;
+}
+
+//----------------------------------------------------------
+// release_device
+//
+// Unmaps and closes an image that is no longer registered. A
+// retired journal is removed, a pending one is kept for replay.
+// Tracked page checksums are saved for the next open.
+//----------------------------------------------------------
+// @param[in]  : hw - device handle
+//
+static void release_device(eeprom_device_t *hw)
+{
+    //a pending journal record changes the image on replay, and
+    //RAM contents are never stored back
+    if ((hw->crc != NULL) && !hw->journal_pending && !hw->crc_saved &&
+        (hw->ops != &ram_ops))
+    {
+        crc_save(hw);
+    }
+    if (hw->ops != NULL)
+    {
+        hw->ops->close(hw);
+    }
+    if (hw->journal_fd >= 0)
+    {
+        close(hw->journal_fd);
+        if (!hw->journal_pending)
+        {
+            unlink(hw->journal_path);
+        }
+    }
+    pthread_mutex_destroy(&hw->journal_lock);
+    pthread_mutex_destroy(&hw->bus_lock);
+    pthread_mutex_destroy(&hw->crc_lock);
+    pthread_mutex_destroy(&hw->fault_lock);
+    free(hw->journal_undo); //closed mid write, as by a crash
+    free(hw->bank_busy);
+    free(hw->crc);
+    free(hw->crc_path);
+    free(hw->journal_path);
+    close(hw->fd);
+    free(hw);
+}
+
+//----------------------------------------------------------
+// journal_crc
+//
+// Checksum stored in and checked against a journal record.
+//----------------------------------------------------------
+// @param[in]  : hdr  - record header
+// @param[in]  : body - extents and data following the header
+// @param[out] : uint32_t - crc32c of header fields and body
+//
+static uint32_t journal_crc(const journal_header_t *hdr, const char *body)
+{
+    uint32_t crc = crc32c(0, hdr, offsetof(journal_header_t, crc));
+    return crc32c(crc, body, hdr->bytes);
+}
+
+//----------------------------------------------------------
+// journal_clear
+//
+// Durably invalidates the journal record.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle, journal open
+// @param[out] : int - 0 on success
+//
+static int journal_clear(eeprom_device_t *hw)
+{
+    const char zero[sizeof(((journal_header_t *)0)->magic)] = {0};
+    if ((pwrite(hw->journal_fd, zero, sizeof(zero), 0) != sizeof(zero)) ||
+        (fdatasync(hw->journal_fd) < 0))
+    {
+        printf("Failed to clear device journal\n");
+        return -EIO;
+    }
+    hw->journal_pending = 0;
+    return 0;
+}
+
+//----------------------------------------------------------
+// journal_replay
+//
+// Rolls forward a record left in the journal. A record that is
+// torn or fails its checksum was never followed by page writes
+// and is discarded.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle, format and lines set
+// @param[out] : int - 0 on success
+//
+static int journal_replay(eeprom_device_t *hw)
+{
+    journal_header_t hdr;
+    struct stat      st;
+    if ((hw->journal_fd < 0) ||
+        (pread(hw->journal_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+        memcmp(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic)))
+    {
+        hw->journal_pending = 0;
+        return 0; //nothing to replay
+    }
+    if ((fstat(hw->journal_fd, &st) < 0) ||
+        (hdr.bytes > st.st_size - sizeof(hdr)) ||
+        (hdr.count > hdr.bytes / sizeof(journal_extent_t)))
+    {
+        return journal_clear(hw);
+    }
+
+    char *body = malloc(hdr.bytes);
+    if (body == NULL)
+    {
+        return -ENOMEM;
+    }
+    if ((pread(hw->journal_fd, body, hdr.bytes, sizeof(hdr)) != hdr.bytes) ||
+        (journal_crc(&hdr, body) != hdr.crc))
+    {
+        free(body);
+        return journal_clear(hw);
+    }
+
+    //extent table was checksummed, but check it fits the data and image
+    const journal_extent_t *ext  = (const journal_extent_t *)body;
+    long                    data = (long)hdr.count*sizeof(journal_extent_t);
+    uint32_t                i;
+    int                     e = 0;
+    for (i = 0; (i < hdr.count) && (e == 0); i++)
+    {
+        if ((ext[i].len < 0) || (ext[i].len > hdr.bytes - data))
+        {
+            e = -EINVAL;
+            break;
+        }
+        e = check_range(hw, ext[i].line_num, ext[i].len);
+        if (e == 0)
+        {
+            e = store_page(hw, ext[i].line_num, body + data, ext[i].len);
+        }
+        data += ext[i].len;
+    }
+    free(body);
+    if (e < 0)
+    {
+        printf("Failed to replay device journal\n");
+        return e;
+    }
+    e = hw->ops->sync(hw);
+    if (e < 0)
+    {
+        return e;
+    }
+    return journal_clear(hw);
+}
+
+//----------------------------------------------------------
+// journal_create
+//
+// Creates the journal file on first journaled write and makes
+// its directory entry durable.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+static int journal_create(eeprom_device_t *hw)
+{
+    hw->journal_fd = open(hw->journal_path, O_RDWR | O_CREAT, 0644);
+    if (hw->journal_fd < 0)
+    {
+        printf("Failed to open device journal %s\n", hw->journal_path);
+        return -EIO;
+    }
+    char *path = strdup(hw->journal_path);
+    if (path == NULL)
+    {
+        return -ENOMEM;
+    }
+    int dir = open(dirname(path), O_RDONLY);
+    free(path);
+    if (dir >= 0)
+    {
+        fsync(dir);
+        close(dir);
+    }
+    return 0;
+}
+
+//Public specification in header
+int eeprom_device_open(const char *path, eeprom_device_backend_t backend,
+    eeprom_device_t **hw)
+{
+    if (hw == NULL)
+    {
+        return -EINVAL;
+    }
+    if (path == NULL)
+    {
+        path = DEVICE_FILE_NAME;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) < 0))
+    {
+        printf("Failed to open device %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        pthread_mutex_unlock(&registry_lock);
+        return -EIO;
+    }
+
+    //same file already open, share its handle
+    eeprom_device_t *dev;
+    for (dev = registry; dev != NULL; dev = dev->next)
+    {
+        if ((dev->st_dev == st.st_dev) && (dev->st_ino == st.st_ino))
+        {
+            close(fd);
+            if (backend != dev->backend)
+            {
+                printf("Device already open with another backend\n");
+                pthread_mutex_unlock(&registry_lock);
+                return -EBUSY;
+            }
+            dev->refs++;
+            *hw = dev;
+            pthread_mutex_unlock(&registry_lock);
+            return 0; //success
+        }
+    }
+
+    dev = calloc(1, sizeof(eeprom_device_t));
+    if (dev == NULL)
+    {
+        close(fd);
+        pthread_mutex_unlock(&registry_lock);
+        return -ENOMEM;
+    }
+    dev->fd     = fd;
+    dev->st_dev = st.st_dev;
+    dev->st_ino = st.st_ino;
+    int result = validate_image(dev, &st);
+    if (result < 0)
+    {
+        close(fd);
+        free(dev);
+        pthread_mutex_unlock(&registry_lock);
+        return result;
+    }
+    dev->lines        = result;
+    dev->ops          = (dev->format == EEPROM_FORMAT_BINARY) ? &binary_ops : &legacy_ops;
+    dev->journal_fd   = -1;
+    dev->journal_path = malloc(strlen(path) + sizeof(JOURNAL_SUFFIX));
+    dev->crc_path     = malloc(strlen(path) + sizeof(CRC_SUFFIX));
+    if ((dev->journal_path == NULL) || (dev->crc_path == NULL))
+    {
+        close(fd);
+        free(dev->journal_path);
+        free(dev->crc_path);
+        free(dev);
+        pthread_mutex_unlock(&registry_lock);
+        return -ENOMEM;
+    }
+    strcpy(dev->journal_path, path);
+    strcat(dev->journal_path, JOURNAL_SUFFIX);
+    strcpy(dev->crc_path, path);
+    strcat(dev->crc_path, CRC_SUFFIX);
+    pthread_mutex_init(&dev->journal_lock, NULL);
+    pthread_mutex_init(&dev->bus_lock, NULL);
+    pthread_mutex_init(&dev->crc_lock, NULL);
+    pthread_mutex_init(&dev->fault_lock, NULL);
+
+    //finish any write interrupted while image was last open
+    dev->journal_fd = open(dev->journal_path, O_RDWR);
+    result = journal_replay(dev);
+    if (result < 0)
+    {
+        release_device(dev);
+        pthread_mutex_unlock(&registry_lock);
+        return result;
+    }
+
+    if (backend == EEPROM_DEVICE_MMAP)
+    {
+        void *map = mmap(NULL, dev->size,
+            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            printf("Failed to map device\n");
+            release_device(dev);
+            pthread_mutex_unlock(&registry_lock);
+            return -EIO;
+        }
+        dev->map = map;
+        dev->ops = &map_ops;
+    }
+    else if (backend == EEPROM_DEVICE_RAM)
+    {
+        //contents as rolled forward above, then the file is left alone
+        dev->ram = malloc(dev->lines);
+        if ((dev->ram == NULL) || (dev->ops->read_range(dev, 0, dev->ram, dev->lines) < 0))
+        {
+            free(dev->ram);
+            release_device(dev);
+            pthread_mutex_unlock(&registry_lock);
+            return -ENOMEM;
+        }
+        dev->ops = &ram_ops;
+    }
+    else if (backend == EEPROM_DEVICE_TIMED)
+    {
+        dev->clock_hz       = TIMED_CLOCK_HZ;
+        dev->write_cycle_ns = (uint64_t)TIMED_WRITE_CYCLE_US * 1000;
+    }
+    dev->backend = backend;
+    dev->refs    = 1;
+    dev->next    = registry;
+    registry     = dev;
+    *hw = dev;
+    pthread_mutex_unlock(&registry_lock);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_device_close(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&registry_lock);
+    if (--hw->refs > 0)
+    {
+        pthread_mutex_unlock(&registry_lock);
+        return 0; //still open elsewhere
+    }
+
+    //last reference, unlink from registry
+    eeprom_device_t **link = &registry;
+    while (*link != hw)
+    {
+        link = &(*link)->next;
+    }
+    *link = hw->next;
+    pthread_mutex_unlock(&registry_lock);
+
+    release_device(hw);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_device_claim_shadow(eeprom_device_t *hw, const void *owner)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    int e = 0;
+    pthread_mutex_lock(&registry_lock);
+    if ((hw->shadow_refs > 0) && (hw->shadow_owner != owner))
+    {
+        e = -EBUSY;
+    }
+    else
+    {
+        hw->shadow_owner = owner;
+        hw->shadow_refs++;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_release_shadow(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&registry_lock);
+    if ((hw->shadow_refs > 0) && (--hw->shadow_refs == 0))
+    {
+        hw->shadow_owner = NULL;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_device_size(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    return hw->lines;
+}
+
+//Public specification in header
+int eeprom_device_page_size(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    return hw->page;
+}
+
+//Public specification in header
+int eeprom_device_format(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    return hw->format;
+}
+
+//Public specification in header
+int eeprom_device_convert(const char *src, const char *dst, uint32_t page_size_bytes)
+{
+    int in = open(src, O_RDONLY);
+    if (in < 0)
+    {
+        printf("Failed to open %s\n", src);
+        return -EIO;
+    }
+    struct stat st;
+    if (fstat(in, &st) < 0)
+    {
+        close(in);
+        return -EIO;
+    }
+    int words = validate_legacy(in, st.st_size);
+    if (words < 0)
+    {
+        close(in);
+        return words;
+    }
+
+    //header followed by data column of every legacy line
+    char *image = calloc(1, EEPROM_IMAGE_HEADER + words);
+    char *lines = malloc(st.st_size);
+    if ((image == NULL) || (lines == NULL) ||
+        (pread(in, lines, st.st_size, 0) != st.st_size))
+    {
+        free(image);
+        free(lines);
+        close(in);
+        return -EIO;
+    }
+    close(in);
+    int i;
+    for (i = 0; i < words; i++)
+    {
+        image[EEPROM_IMAGE_HEADER + i] = lines[i*LINE_LEN];
+    }
+    free(lines);
+
+    eeprom_image_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, EEPROM_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version         = EEPROM_IMAGE_VERSION;
+    hdr.header_size     = EEPROM_IMAGE_HEADER;
+    hdr.size_words      = words;
+    hdr.page_size_bytes = page_size_bytes;
+    hdr.word_size_bits  = 8;
+    hdr.header_crc      = header_crc(&hdr);
+    memcpy(image, &hdr, sizeof(hdr));
+
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+    {
+        printf("Failed to open %s\n", dst);
+        free(image);
+        return -EIO;
+    }
+    ssize_t len = EEPROM_IMAGE_HEADER + words;
+    int result = (write(out, image, len) == len) ? 0 : -EIO;
+    close(out);
+    free(image);
+    return result;
+}
+
+//----------------------------------------------------------
+// now_ns
+//
+// Monotonic clock used by the bus timing model.
+//----------------------------------------------------------
+// @param[out] : uint64_t - time in ns
+//
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//----------------------------------------------------------
+// sleep_until
+//
+// Blocks until the monotonic clock reaches deadline.
+//----------------------------------------------------------
+// @param[in]  : deadline - monotonic time in ns
+//
+static void sleep_until(uint64_t deadline)
+{
+    struct timespec ts;
+    ts.tv_sec  = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+//----------------------------------------------------------
+// busy_slot
+//
+// End of the write cycle of the part addressed by line_num.
+// Banks share the bus but each runs its own write cycle.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, bus held
+// @param[in]  : line_num - address within the part
+// @param[out] : uint64_t* - write cycle deadline of the part
+//
+static uint64_t *busy_slot(eeprom_device_t *hw, int line_num)
+{
+    if (hw->bank_busy == NULL)
+    {
+        return &hw->busy_until;
+    }
+    return &hw->bank_busy[line_num / hw->bank_lines];
+}
+
+//----------------------------------------------------------
+// bus_begin
+//
+// Starts a timed transaction by taking the bus and sending the
+// control byte. A part still in its write cycle does not ACK.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, timing enabled
+// @param[in]  : line_num - address the transaction starts at
+// @param[in]  : start    - receives transaction start time
+// @param[out] : int      - 0 with bus held, -EAGAIN if part busy
+//
+static int bus_begin(eeprom_device_t *hw, int line_num, uint64_t *start)
+{
+    pthread_mutex_lock(&hw->bus_lock);
+    uint64_t now = now_ns();
+    if (now < *busy_slot(hw, line_num))
+    {
+        uint64_t clocks = I2C_COND_CLOCKS + I2C_BYTE_CLOCKS + I2C_COND_CLOCKS;
+        sleep_until(now + clocks * 1000000000ull / hw->clock_hz);
+        pthread_mutex_unlock(&hw->bus_lock);
+        return -EAGAIN;
+    }
+    *start = now;
+    return 0;
+}
+
+//----------------------------------------------------------
+// bus_end
+//
+// Completes a timed transaction once its clocks have elapsed
+// and releases the bus. A page write starts the write cycle.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle, bus held
+// @param[in]  : line_num - address the transaction started at
+// @param[in]  : start    - transaction start time
+// @param[in]  : clocks   - SCL clocks of the whole transaction
+// @param[in]  : write    - nonzero for a page write
+//
+static void bus_end(eeprom_device_t *hw, int line_num, uint64_t start,
+    uint64_t clocks, int write)
+{
+    uint64_t done = start + clocks * 1000000000ull / hw->clock_hz;
+    sleep_until(done);
+    if (write)
+    {
+        *busy_slot(hw, line_num) = done + hw->write_cycle_ns;
+    }
+    pthread_mutex_unlock(&hw->bus_lock);
+}
+
+//Public specification in header
+int eeprom_device_set_timing(eeprom_device_t *hw, const eeprom_device_timing_t *timing)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    pthread_mutex_lock(&hw->bus_lock);
+    hw->write_cycle_ns = (timing != NULL) ? (uint64_t)timing->write_cycle_us * 1000 : 0;
+    hw->busy_until     = 0;
+    if (hw->bank_busy != NULL)
+    {
+        memset(hw->bank_busy, 0, ((hw->lines + hw->bank_lines - 1) / hw->bank_lines) *
+            sizeof(uint64_t));
+    }
+    __atomic_store_n(&hw->clock_hz, (timing != NULL) ? timing->clock_hz : 0,
+        __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&hw->bus_lock);
+    return 0; //success
+}
+
+//Public specification in header
+uint64_t eeprom_device_write_cycle(eeprom_device_t *hw)
+{
+    if ((hw == NULL) || !__atomic_load_n(&hw->clock_hz, __ATOMIC_RELAXED))
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&hw->bus_lock);
+    uint64_t twr = hw->write_cycle_ns;
+    pthread_mutex_unlock(&hw->bus_lock);
+    return twr;
+}
+
+//Public specification in header
+int eeprom_device_set_banks(eeprom_device_t *hw, int bank_size)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    if (bank_size < 0)
+    {
+        return -EINVAL;
+    }
+    uint64_t *busy = NULL;
+    if ((bank_size > 0) && (bank_size < hw->lines))
+    {
+        busy = calloc((hw->lines + bank_size - 1) / bank_size, sizeof(uint64_t));
+        if (busy == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+    else
+    {
+        bank_size = 0; //one bank covers the image
+    }
+    pthread_mutex_lock(&hw->bus_lock);
+    free(hw->bank_busy);
+    hw->bank_busy  = busy;
+    hw->bank_lines = bank_size;
+    pthread_mutex_unlock(&hw->bus_lock);
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// take_fault
+//
+// Consumes one transaction of an injected fault schedule.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - error to fail the transaction with, 0 to run it
+//
+static int take_fault(eeprom_device_t *hw)
+{
+    int e = 0;
+    pthread_mutex_lock(&hw->fault_lock);
+    if (hw->fault_skip > 0)
+    {
+        hw->fault_skip--;
+    }
+    else if (hw->fault_count > 0)
+    {
+        hw->fault_count--;
+        e = hw->fault_error;
+    }
+    pthread_mutex_unlock(&hw->fault_lock);
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_inject_fault(eeprom_device_t *hw, int skip, int count, int error)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    if ((skip < 0) || (count < 0) || (error >= 0))
+    {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&hw->fault_lock);
+    hw->fault_skip  = skip;
+    hw->fault_count = count;
+    hw->fault_error = error;
+    pthread_mutex_unlock(&hw->fault_lock);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_device_write_page(eeprom_device_t *hw, int line_num, const char *buf, int len)
+{
+    int e = check_range(hw, line_num, len);
+    if ((e < 0) || ((e = take_fault(hw)) < 0))
+    {
+        return e;
+    }
+    if (__atomic_load_n(&hw->clock_hz, __ATOMIC_RELAXED) == 0)
+    {
+        return store_page(hw, line_num, buf, len);
+    }
+
+    //start, control, word address, data, stop
+    uint64_t start;
+    e = bus_begin(hw, line_num, &start);
+    if (e < 0)
+    {
+        return e;
+    }
+    e = store_page(hw, line_num, buf, len);
+    bus_end(hw, line_num, start, 2*I2C_COND_CLOCKS +
+        (uint64_t)(1 + I2C_ADDR_BYTES + len) * I2C_BYTE_CLOCKS, e == 0);
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_read_range(eeprom_device_t *hw, int line_num, char *buf, int len)
+{
+    int e = check_range(hw, line_num, len);
+    if ((e < 0) || ((e = take_fault(hw)) < 0))
+    {
+        return e;
+    }
+    if (__atomic_load_n(&hw->clock_hz, __ATOMIC_RELAXED) == 0)
+    {
+        return hw->ops->read_range(hw, line_num, buf, len);
+    }
+
+    //random read: dummy write of word address, repeated start,
+    //control byte, data clocked out, stop
+    uint64_t start;
+    e = bus_begin(hw, line_num, &start);
+    if (e < 0)
+    {
+        return e;
+    }
+    e = hw->ops->read_range(hw, line_num, buf, len);
+    bus_end(hw, line_num, start, 3*I2C_COND_CLOCKS +
+        (uint64_t)(2 + I2C_ADDR_BYTES + len) * I2C_BYTE_CLOCKS, 0);
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_enable_crc(eeprom_device_t *hw, int page_size)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    if (page_size <= 0)
+    {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&hw->crc_lock);
+    if (hw->crc != NULL)
+    {
+        //already tracked for another user of the image
+        int e = (hw->crc_page == page_size) ? 0 : -EBUSY;
+        pthread_mutex_unlock(&hw->crc_lock);
+        return e;
+    }
+
+    const int pages = (hw->lines + page_size - 1) / page_size;
+    uint32_t *crc   = malloc((size_t)pages*sizeof(uint32_t));
+    if (crc == NULL)
+    {
+        pthread_mutex_unlock(&hw->crc_lock);
+        return -ENOMEM;
+    }
+    hw->crc      = crc;
+    hw->crc_page = page_size;
+    if (crc_load(hw) == 0)
+    {
+        hw->crc_saved = 1;
+        pthread_mutex_unlock(&hw->crc_lock);
+        return 0; //success
+    }
+
+    //nothing saved, or the image changed since: start from contents
+    int e = 0;
+    int p;
+    for (p = 0; (p < pages) && (e == 0); p++)
+    {
+        int start = p*page_size;
+        int n     = (hw->lines-start < page_size) ? hw->lines-start : page_size;
+        e = range_crc(hw, start, n, &crc[p]);
+    }
+    if (e < 0)
+    {
+        hw->crc = NULL;
+        free(crc);
+    }
+    pthread_mutex_unlock(&hw->crc_lock);
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_page_crc(eeprom_device_t *hw, int page, uint32_t *crc)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    if (crc == NULL)
+    {
+        return -EINVAL;
+    }
+    int e = 0;
+    pthread_mutex_lock(&hw->crc_lock);
+    if (hw->crc == NULL)
+    {
+        e = -ENOENT;
+    }
+    else if ((page < 0) || (page > (hw->lines - 1) / hw->crc_page))
+    {
+        e = -EFAULT;
+    }
+    else
+    {
+        *crc = hw->crc[page];
+    }
+    pthread_mutex_unlock(&hw->crc_lock);
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_map_ro(eeprom_device_t *hw, int line_num, int len, const char **ptr)
+{
+    int e = check_range(hw, line_num, len);
+    if (e < 0)
+    {
+        return e;
+    }
+    if (hw->ram != NULL)
+    {
+        *ptr = hw->ram + line_num;
+        return 0; //success
+    }
+    if ((hw->map == NULL) || (hw->format != EEPROM_FORMAT_BINARY))
+    {
+        return -ENOTSUP; //contents not laid out contiguously in memory
+    }
+    *ptr = hw->map + hw->base + line_num;
+    return 0; //success
+}
+
+//Public specification in header
+uint64_t eeprom_device_generation(eeprom_device_t *hw)
+{
+    return __atomic_load_n(&hw->gen, __ATOMIC_ACQUIRE);
+}
+
+//Public specification in header
+int eeprom_device_flush(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    return hw->ops->flush(hw);
+}
+
+//Public specification in header
+int eeprom_device_sync(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    return hw->ops->sync(hw);
+}
+
+//Public specification in header
+const char *eeprom_device_backend_name(eeprom_device_t *hw)
+{
+    if (hw == NULL)
+    {
+        return NULL;
+    }
+    return hw->ops->name;
+}
+
+//----------------------------------------------------------
+// journal_save
+//
+// Keeps the current contents of every extent of a journaled
+// write, laid out as a journal record body, so a write that
+// fails part way can be rolled back by journal_rollback.
+//----------------------------------------------------------
+// @param[in]  : hw    - device handle, journal held
+// @param[in]  : ext   - extents about to be written, range checked
+// @param[in]  : count - number of extents
+// @param[out] : int   - 0 on success
+//
+static int journal_save(eeprom_device_t *hw, const eeprom_device_extent_t *ext, int count)
+{
+    long bytes = (long)count*sizeof(journal_extent_t);
+    int  i;
+    for (i = 0; i < count; i++)
+    {
+        bytes += ext[i].len;
+    }
+    char *undo = malloc(bytes);
+    if (undo == NULL)
+    {
+        return -ENOMEM;
+    }
+    journal_extent_t *table = (journal_extent_t *)undo;
+    long              data  = (long)count*sizeof(journal_extent_t);
+    int               e     = 0;
+    for (i = 0; (i < count) && (e == 0); i++)
+    {
+        table[i].line_num = ext[i].line_num;
+        table[i].len      = ext[i].len;
+        e = hw->ops->read_range(hw, ext[i].line_num, undo + data, ext[i].len);
+        data += ext[i].len;
+    }
+    if (e < 0)
+    {
+        free(undo);
+        return e;
+    }
+    hw->journal_undo       = undo;
+    hw->journal_undo_count = count;
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// journal_rollback
+//
+// Stores back the contents kept by journal_save and frees them.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle, journal held
+// @param[out] : int - 0 on success
+//
+static int journal_rollback(eeprom_device_t *hw)
+{
+    const journal_extent_t *table = (const journal_extent_t *)hw->journal_undo;
+    long                    data  = (long)hw->journal_undo_count*sizeof(journal_extent_t);
+    int                     e     = 0;
+    int                     i;
+    for (i = 0; (i < hw->journal_undo_count) && (e == 0); i++)
+    {
+        e = store_page(hw, table[i].line_num, hw->journal_undo + data, table[i].len);
+        data += table[i].len;
+    }
+    if ((e == 0) && (hw->ops != &ram_ops))
+    {
+        e = hw->ops->sync(hw);
+    }
+    free(hw->journal_undo);
+    hw->journal_undo       = NULL;
+    hw->journal_undo_count = 0;
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_journal_begin(eeprom_device_t *hw,
+    const eeprom_device_extent_t *ext, int count)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    if ((ext == NULL) || (count <= 0))
+    {
+        return -EINVAL;
+    }
+    journal_header_t hdr;
+    memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic));
+    hdr.count = count;
+    hdr.bytes = count*sizeof(journal_extent_t);
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        int e = check_range(hw, ext[i].line_num, ext[i].len);
+        if (e < 0)
+        {
+            return e;
+        }
+        hdr.bytes += ext[i].len;
+    }
+    if (hw->ops == &ram_ops)
+    {
+        //nothing survives a crash to roll forward into
+        pthread_mutex_lock(&hw->journal_lock);
+        int e = journal_save(hw, ext, count);
+        if (e < 0)
+        {
+            pthread_mutex_unlock(&hw->journal_lock);
+            return e;
+        }
+        return 0; //success, journal held
+    }
+
+    //header, extent table and data stored with one positioned write
+    char *record = malloc(sizeof(hdr) + hdr.bytes);
+    if (record == NULL)
+    {
+        return -ENOMEM;
+    }
+    char             *body  = record + sizeof(hdr);
+    journal_extent_t *table = (journal_extent_t *)body;
+    long              data  = (long)count*sizeof(journal_extent_t);
+    for (i = 0; i < count; i++)
+    {
+        table[i].line_num = ext[i].line_num;
+        table[i].len      = ext[i].len;
+        memcpy(body + data, ext[i].buf, ext[i].len);
+        data += ext[i].len;
+    }
+    hdr.crc = journal_crc(&hdr, body);
+    memcpy(record, &hdr, sizeof(hdr));
+
+    pthread_mutex_lock(&hw->journal_lock);
+    int e = 0;
+    if (hw->journal_fd < 0)
+    {
+        e = journal_create(hw);
+    }
+    else if (hw->journal_pending)
+    {
+        e = journal_replay(hw);
+    }
+    if (e == 0)
+    {
+        e = journal_save(hw, ext, count);
+    }
+    if ((e == 0) &&
+        ((pwrite(hw->journal_fd, record, sizeof(hdr) + hdr.bytes, 0) != sizeof(hdr) + hdr.bytes) ||
+         (fdatasync(hw->journal_fd) < 0)))
+    {
+        printf("Failed to write device journal\n");
+        free(hw->journal_undo);
+        hw->journal_undo = NULL;
+        e = -EIO;
+    }
+    free(record);
+    if (e < 0)
+    {
+        pthread_mutex_unlock(&hw->journal_lock);
+        return e;
+    }
+    hw->journal_pending = 1;
+    return 0; //success, journal held
+}
+
+//Public specification in header
+int eeprom_device_journal_end(eeprom_device_t *hw, int retire)
+{
+    if (hw == NULL)
+    {
+        return -ENODEV;
+    }
+    int e = 0;
+    if (retire)
+    {
+        free(hw->journal_undo);
+        hw->journal_undo = NULL;
+        if (hw->ops != &ram_ops)
+        {
+            //record may only go once the page writes are durable
+            e = hw->ops->sync(hw);
+            if (e == 0)
+            {
+                e = journal_clear(hw);
+            }
+        }
+    }
+    else
+    {
+        //settle the failed write before anyone else writes: put
+        //the extents back as they were, or else finish them all
+        e = journal_rollback(hw);
+        if ((e == 0) && hw->journal_pending)
+        {
+            e = journal_clear(hw);
+        }
+        else if ((e < 0) && hw->journal_pending)
+        {
+            e = (journal_replay(hw) == 0) ? 1 : e;
+        }
+        if ((e < 0) && hw->journal_pending)
+        {
+            //neither way through, never replay it over later writes
+            journal_clear(hw);
+        }
+    }
+    pthread_mutex_unlock(&hw->journal_lock);
+    return e;
+}
+
+//Public specification in header
+int eeprom_device_write(eeprom_device_t *hw, int line_num, char new_char)
+{
+    return eeprom_device_write_page(hw, line_num, &new_char, 1);
+}
+
+//Public specification in header
+int eeprom_device_read(eeprom_device_t *hw, int line_num, char *char_read)
+{
+    return eeprom_device_read_range(hw, line_num, char_read, 1);
 }
@@ -13,34 +13,497 @@
 
 #define DEVICE_FILE_NAME "device/eeprom.dat"
 
+//Binary image format: a fixed EEPROM_IMAGE_HEADER byte header
+//followed by the raw device contents, so address a is stored at
+//file offset header_size + a. Fields are stored in host (little
+//endian) byte order.
+#define EEPROM_IMAGE_MAGIC   "EEPB"
+#define EEPROM_IMAGE_VERSION 1
+#define EEPROM_IMAGE_HEADER  64
+
+typedef struct eeprom_image_header
+{
+    //EEPROM_IMAGE_MAGIC, never a valid legacy image since the
+    //second byte of a legacy image is always '\n'
+    char magic[4];
+
+    //EEPROM_IMAGE_VERSION
+    uint16_t version;
+
+    //file offset of device contents
+    uint16_t header_size;
+
+    //device geometry
+    uint32_t size_words;
+    uint32_t page_size_bytes;
+    uint32_t word_size_bits;
+
+    uint8_t reserved[40];
+
+    //crc32c of every preceding header byte
+    uint32_t header_crc;
+
+} eeprom_image_header_t;
+
+//On-disk layout of the device image file
+typedef enum eeprom_device_format
+{
+    //one data byte followed by '\n' per address, as written by
+    //device/fill_eeprom.py
+    EEPROM_FORMAT_LEGACY = 0,
+
+    //eeprom_image_header_t then raw contents
+    EEPROM_FORMAT_BINARY,
+
+} eeprom_device_format_t;
+
+//How the device image file is accessed
+typedef enum eeprom_device_backend
+{
+    //positioned read/write on the image file descriptor
+    EEPROM_DEVICE_PIO = 0,
+
+    //shared memory mapping of the image file; reads copy out of
+    //the mapping, page writes store in place then msync the
+    //touched range
+    EEPROM_DEVICE_MMAP,
+
+    //contents loaded into memory on open; transactions never
+    //touch the file again and every write is lost on close
+    EEPROM_DEVICE_RAM,
+
+    //positioned file i/o behind the bus timing model, preset to a
+    //24C64 at 400 kHz with a 5 ms write cycle; see
+    //eeprom_device_set_timing to change either
+    EEPROM_DEVICE_TIMED,
+
+} eeprom_device_backend_t;
+
+
+//I2C bus timing of a 24Cxx-class part, see eeprom_device_set_timing
+typedef struct eeprom_device_timing
+{
+    //SCL frequency, 100000/400000/1000000; zero disables the model
+    //so transactions complete as fast as the image file allows
+    uint32_t clock_hz;
+
+    //internal write cycle time (tWR) after each page write, during
+    //which the part does not acknowledge its control byte
+    uint32_t write_cycle_us;
+
+} eeprom_device_timing_t;
+
+//Write-ahead journal kept beside the image as <image>JOURNAL_SUFFIX.
+//A record holds every extent of one logical write; records that
+//are torn or fail their checksum are discarded on replay.
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_MAGIC  "EEPJ"
+
+//Page checksums kept beside the image as <image>CRC_SUFFIX, saved
+//on the last close and removed again on the next page write, so a
+//table on disk always describes the image as last closed.
+#define CRC_SUFFIX ".crc"
+#define CRC_MAGIC  "EEPC"
+
+//One contiguous run of a journaled write
+typedef struct eeprom_device_extent
+{
+    //first file line number indexed at 0
+    int line_num;
+
+    //number of bytes
+    int len;
+
+    //data to store
+    const char *buf;
+
+} eeprom_device_extent_t;
+
+
+//Open device image, one per backing file. Opaque outside the
+//hardware tier.
+typedef struct eeprom_device eeprom_device_t;
+
+
+//----------------------------------------------------------
+// eeprom_device_open
+//
+// Powers up the fake EEPROM backed by the image file at path,
+// detecting its format and validating the image once. Open
+// devices are kept in a registry keyed by path: opening the
+// same file again returns the same handle with its reference
+// count raised, while different files get independent handles
+// that share no state. A journal record left by an interrupted
+// write is replayed before the handle is returned. The file descriptor (and mapping, for
+// EEPROM_DEVICE_MMAP) is held until the last matching
+// eeprom_device_close so individual transactions never rescan
+// or reopen the file. Every reference to one file must use the
+// same backend.
+//----------------------------------------------------------
+// @param[in]  : path    - image file, NULL for DEVICE_FILE_NAME
+// @param[in]  : backend - image access method
+// @param[in]  : hw      - receives device handle
+// @param[out] : int     - 0 on success, -EBUSY on backend mismatch
+//
+int eeprom_device_open(const char *path, eeprom_device_backend_t backend,
+    eeprom_device_t **hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_close
+//
+// Drops one reference taken by eeprom_device_open. The image
+// file is closed when the last reference is released.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+int eeprom_device_close(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_claim_shadow
+//
+// Records that a RAM shadow of the image is kept by owner. Every
+// device struct sharing the handle must see the same shadow, so
+// while one owner holds a claim any other owner is refused. One
+// owner may claim several times, releasing as often.
+//----------------------------------------------------------
+// @param[in]  : hw    - device handle
+// @param[in]  : owner - shadow identity
+// @param[out] : int   - 0 on success, -EBUSY if held by another owner
+//
+int eeprom_device_claim_shadow(eeprom_device_t *hw, const void *owner);
+
+
+//----------------------------------------------------------
+// eeprom_device_release_shadow
+//
+// Drops one claim taken by eeprom_device_claim_shadow.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+int eeprom_device_release_shadow(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_size
+//
+// Returns number of addressable bytes (lines) in the open
+// device image.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - number of bytes, negative on error
+//
+int eeprom_device_size(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_page_size
+//
+// Returns page size recorded in the open device image, or 0
+// when the image format does not record geometry.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - page size in bytes, negative on error
+//
+int eeprom_device_page_size(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_format
+//
+// Returns format of the open device image.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - eeprom_device_format_t, negative on error
+//
+int eeprom_device_format(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_convert
+//
+// Writes a binary format copy of the legacy image at src to
+// dst. src must not be open. Also available offline as
+// device/convert_eeprom.py.
+//----------------------------------------------------------
+// @param[in]  : src             - legacy image path
+// @param[in]  : dst             - binary image path, replaced
+// @param[in]  : page_size_bytes - page size recorded in header
+// @param[out] : int             - 0 on success
+//
+int eeprom_device_convert(const char *src, const char *dst, uint32_t page_size_bytes);
+
+
+//----------------------------------------------------------
+// eeprom_device_write_page
+//
+// Fakes an EEPROM I2C page write transaction: address is sent
+// once followed by len data bytes, all stored in the image
+// with a single positioned write. Caller is responsible for
+// keeping [line_num, line_num+len) inside one page.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - bytes to write
+// @param[in]  : len      - number of bytes to write
+// @param[out] : int      - 0 on success, -EAGAIN while busy
+//
+int eeprom_device_write_page(eeprom_device_t *hw, int line_num, const char *buf, int len);
+
+
+//----------------------------------------------------------
+// eeprom_device_read_range
+//
+// Fakes an EEPROM I2C sequential read transaction: address is
+// sent once and len bytes are clocked out starting at line_num.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : buf      - destination buffer of at least len bytes
+// @param[in]  : len      - number of bytes to read
+// @param[out] : int      - 0 on success, -EAGAIN while busy
+//
+int eeprom_device_read_range(eeprom_device_t *hw, int line_num, char *buf, int len);
+
+
+//----------------------------------------------------------
+// eeprom_device_set_timing
+//
+// Makes every later transaction on hw take as long on the wall
+// clock as it would on a real bus: 9 clocks per byte (8 data
+// bits and ACK) plus start/stop conditions, with the control
+// byte and a 2 byte word address sent ahead of the data. A
+// page write leaves the part busy for tWR; until then every
+// transaction costs one control byte and fails with -EAGAIN,
+// so callers must ACK-poll. Transactions on hw are serialized
+// as on one physical bus. Applies to every user of the image.
+//----------------------------------------------------------
+// @param[in]  : hw     - device handle
+// @param[in]  : timing - bus parameters, NULL or zero clock to disable
+// @param[out] : int    - 0 on success
+//
+int eeprom_device_set_timing(eeprom_device_t *hw, const eeprom_device_timing_t *timing);
+
+
+//----------------------------------------------------------
+// eeprom_device_write_cycle
+//
+// Returns the write cycle time (tWR) of the part, the longest a
+// busy part leaves a transaction unacknowledged; zero when
+// transactions are untimed, so the part is never busy.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle
+// @param[out] : uint64_t - tWR in ns
+//
+uint64_t eeprom_device_write_cycle(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_set_banks
+//
+// Describes the image as consecutive chips of bank_size bytes
+// stacked behind chip-select bits. Under the bus timing model
+// each bank runs its own write cycle, so a bank accepts
+// transactions while another is still busy. Blocks of one chip
+// picked by block-select bits share its write cycle and are not
+// banks. Applies to every user of the image.
+//----------------------------------------------------------
+// @param[in]  : hw        - device handle
+// @param[in]  : bank_size - bytes per bank, 0 for a single part
+// @param[out] : int       - 0 on success
+//
+int eeprom_device_set_banks(eeprom_device_t *hw, int bank_size);
+
+
+//----------------------------------------------------------
+// eeprom_device_map_ro
+//
+// Returns the address of line_num inside the image mapping so
+// its bytes can be read in place. Only EEPROM_DEVICE_RAM devices
+// and EEPROM_DEVICE_MMAP images in binary format hold contents
+// contiguously in memory. The pointer stays
+// valid until the last eeprom_device_close of the image; page
+// writes change the bytes underneath it, see
+// eeprom_device_generation.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle
+// @param[in]  : line_num - first file line number indexed at 0
+// @param[in]  : len      - number of bytes to be read
+// @param[in]  : ptr      - receives address of first byte
+// @param[out] : int      - 0 on success, -ENOTSUP if not mapped
+//
+int eeprom_device_map_ro(eeprom_device_t *hw, int line_num, int len, const char **ptr);
+
+
+//----------------------------------------------------------
+// eeprom_device_generation
+//
+// Returns a count raised before and after every page write is
+// stored in the image, so it is odd while one is in progress.
+// Bytes read in place are consistent if the count was even and
+// unchanged around the read.
+//----------------------------------------------------------
+// @param[in]  : hw       - device handle
+// @param[out] : uint64_t - write generation of the image
+//
+uint64_t eeprom_device_generation(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_inject_fault
+//
+// Makes page write and sequential read transactions on hw fail
+// as a flaky bus would: after skip more transactions complete,
+// the next count fail with error without touching the image.
+// A new call replaces the schedule; count zero clears it.
+// Applies to every user of the image.
+//----------------------------------------------------------
+// @param[in]  : hw    - device handle
+// @param[in]  : skip  - transactions to let through first
+// @param[in]  : count - transactions to fail
+// @param[in]  : error - negative errno returned by each failure
+// @param[out] : int   - 0 on success
+//
+int eeprom_device_inject_fault(eeprom_device_t *hw, int skip, int count, int error);
+
+
+//----------------------------------------------------------
+// eeprom_device_flush
+//
+// Starts writeback of every page write stored so far without
+// waiting for it to complete.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+int eeprom_device_flush(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_sync
+//
+// Returns once every page write stored so far is durable in the
+// image file. No-op for EEPROM_DEVICE_RAM.
+//----------------------------------------------------------
+// @param[in]  : hw  - device handle
+// @param[out] : int - 0 on success
+//
+int eeprom_device_sync(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_backend_name
+//
+// Names the backend serving hw: "legacy" or "binary" for
+// positioned i/o on either format, "mmap" or "ram".
+//----------------------------------------------------------
+// @param[in]  : hw           - device handle
+// @param[out] : const char*  - backend name, NULL if not open
+//
+const char *eeprom_device_backend_name(eeprom_device_t *hw);
+
+
+//----------------------------------------------------------
+// eeprom_device_journal_begin
+//
+// Makes a multi-page write atomic: stores every extent in the
+// image's journal and syncs it before the caller issues the
+// page writes, so a crash part way through is rolled forward on
+// the next eeprom_device_open. Journaled writes to one image are
+// serialized; the journal is held until eeprom_device_journal_end.
+//----------------------------------------------------------
+// @param[in]  : hw    - device handle
+// @param[in]  : ext   - extents about to be written
+// @param[in]  : count - number of extents
+// @param[out] : int   - 0 on success, journal not held on error
+//
+int eeprom_device_journal_begin(eeprom_device_t *hw,
+    const eeprom_device_extent_t *ext, int count);
+
+
+//----------------------------------------------------------
+// eeprom_device_journal_end
+//
+// Releases the journal taken by eeprom_device_journal_begin.
+// With retire set the image is synced and the record discarded.
+// Otherwise the write failed part way and is settled before the
+// journal is released: every extent is put back as it was before
+// journal_begin or, if that fails, the record is rolled forward.
+// A record neither way can settle is discarded, never replayed
+// over later writes.
+//----------------------------------------------------------
+// @param[in]  : hw     - device handle
+// @param[in]  : retire - nonzero once every extent was written
+// @param[out] : int    - 0 on success or once rolled back, 1 if
+//                        rolled forward, negative if unsettled
+//
+int eeprom_device_journal_end(eeprom_device_t *hw, int retire);
+
+
+//----------------------------------------------------------
+// eeprom_device_enable_crc
+//
+// Starts tracking a crc32c per page_size bytes of the image, the
+// last page possibly short. Every later page write recomputes the
+// checksum of the pages it touched. The table saved by the last
+// clean close is loaded when it has the same geometry, so
+// contents can be checked against what was written before;
+// otherwise the table is computed from the current contents.
+// Applies to every user of the image.
+//----------------------------------------------------------
+// @param[in]  : hw        - device handle
+// @param[in]  : page_size - bytes covered by each checksum
+// @param[out] : int       - 0 on success, -EBUSY if already
+//                           tracked with another page size
+//
+int eeprom_device_enable_crc(eeprom_device_t *hw, int page_size);
+
+
+//----------------------------------------------------------
+// eeprom_device_page_crc
+//
+// Returns the tracked checksum of one page, see
+// eeprom_device_enable_crc.
+//----------------------------------------------------------
+// @param[in]  : hw   - device handle
+// @param[in]  : page - page index, address / page_size
+// @param[in]  : crc  - receives crc32c of the page
+// @param[out] : int  - 0 on success, -ENOENT when not tracked
+//
+int eeprom_device_page_crc(eeprom_device_t *hw, int page, uint32_t *crc);
+
+
 //----------------------------------------------------------
 // eeprom_device_write
 //
 // Fakes an EEPROM I2C write transaction by writing byte to
-// file DEVICE_FILE_NAME at line_num. This function creates a
-// temporary file with the new datum inserted, then removes
-// the old file. Mutex required due to reentrant code.
+// the image at line_num. Every line has the same width so the
+// byte is stored in place with one positioned write.
 //----------------------------------------------------------
+// @param[in]  : hw       - device handle
 // @param[in]  : line_num - file line number indexed at 0
 // @param[in]  : new_char - char (byte) to write
 // @param[out] : int      - 0 on success
 //
-int eeprom_device_write(int line_num, char new_char);
+int eeprom_device_write(eeprom_device_t *hw, int line_num, char new_char);
 
 
 //----------------------------------------------------------
 // eeprom_device_read
 //
-// Fakes an EEPROM I2C read transaction by reading from file
-// DEVICE_FILE_NAME at line_num and stores associated byte in
-// user specified char buffer array location. Mutex required
-// due to reentrant code.
+// Fakes an EEPROM I2C read transaction by reading from the
+// image at line_num and stores associated byte in user
+// specified char buffer array location.
 //----------------------------------------------------------
+// @param[in]  : hw        - device handle
 // @param[in]  : line_num  - file line number indexed at 0
 // @param[in]  : char_read - pointer to location in buffer array
 // @param[out] : int       - 0 on success
 //
-int eeprom_device_read(int line_num, char *char_read);
+int eeprom_device_read(eeprom_device_t *hw, int line_num, char *char_read);
 
 
 #endif
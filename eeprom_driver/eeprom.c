@@ -5,8 +5,18 @@
  */
 
 #include "eeprom.h"
-#include "device/eeprom_device.h"
+#include "eeprom_async.h"
+#include "eeprom_diff.h"
+#include "eeprom_sched.h"
+#include "device/crc32c.h"
 
+#include <sched.h>
+
+#define MAP_SPIN_LIMIT 65536 //busy generations before eeprom_map_ro locks
+
+//shadow owner of every EEPROM_F_CACHE view of a shared segment,
+//see eeprom_device_claim_shadow
+static const char shm_shadow_owner = 0;
 
 //----------------------------------------------------------
 // calc_first_write
@@ -30,14 +40,14 @@ int calc_first_write(int size, int page_space)
 //----------------------------------------------------------
 // @param[in]  : size - total number of bytes to write
 // @param[in]  : first_write_size - bytes written in first page
-// @param[in]  : page_size_bytes - num of bytes in one page
+// @param[in]  : geom - device page geometry
 // @param[out] : int - num bytes to write in last page
 //
-int calc_last_write(int size, int first_write_size, int page_size_bytes)
+int calc_last_write(int size, int first_write_size, const eeprom_geom_t *geom)
 {
     if (size > first_write_size)
     {
-        return (size - first_write_size) % page_size_bytes;
+        return eeprom_geom_offset(geom, size - first_write_size);
     }
     else
     {
@@ -53,17 +63,17 @@ int calc_last_write(int size, int first_write_size, int page_size_bytes)
 //----------------------------------------------------------
 // @param[in]  : size - total number of bytes to write
 // @param[in]  : first_write_size - bytes written in first page
-// @param[in]  : page_size_bytes - num of bytes in one page
+// @param[in]  : geom - device page geometry
 // @param[out] : int - num bytes to write in last page
 //
-int calc_total_writes(int size, int first_write_size, int page_size_bytes)
+int calc_total_writes(int size, int first_write_size, const eeprom_geom_t *geom)
 {
     int       inter_num_writes = 0;
     int       total_num_writes = 0;
     const int first_plus_last  = 2;
     if (size > first_write_size)
     {
-        inter_num_writes = (size - first_write_size) / page_size_bytes;
+        inter_num_writes = eeprom_geom_page(geom, size - first_write_size);
         total_num_writes = inter_num_writes + first_plus_last;
     }
     else
@@ -73,6 +83,388 @@ int calc_total_writes(int size, int first_write_size, int page_size_bytes)
     return total_num_writes;
 }
 
+//----------------------------------------------------------
+// shm_repair
+//
+// Repairs the shared shadow after its mutex was taken from a
+// process that died holding it, see eeprom_shm_lock. Called with
+// the segment mutex held; the shadow may not be attached yet
+// while dev is being opened.
+//----------------------------------------------------------
+// @param[in]  : dev - process independent device struct
+// @param[out] : int - 0 on success
+//
+static int shm_repair(eeprom_dev_t *dev)
+{
+    if (!dev->shm->recovered || (dev->shm->cached && (dev->cache == NULL)))
+    {
+        return 0; //nothing left half done, or no view of it yet
+    }
+    if (dev->cache != NULL)
+    {
+        int e = eeprom_cache_repair(dev->cache);
+        if (e < 0)
+        {
+            return e; //stays recovered, next holder tries again
+        }
+    }
+    dev->shm->recovered = 0;
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// lock_range
+//
+// Takes the device lock for a transaction on [addr, addr+len).
+// With shared state that is the segment's process shared mutex,
+// repaired first if its last owner died holding it. With a
+// striped page lock only the stripes covering the range are
+// held, shared for reads; otherwise the device mutex.
+//----------------------------------------------------------
+// @param[in]  : dev      - process independent device struct
+// @param[in]  : addr     - effective device address
+// @param[in]  : len      - number of bytes
+// @param[in]  : write    - nonzero if range is modified
+// @param[in]  : acquired - receives time lock was acquired
+// @param[out] : int      - 0 on success, lock not held on error
+//
+static int lock_range(eeprom_dev_t *dev, uint32_t addr, uint32_t len, int write,
+    uint64_t *acquired)
+{
+    uint64_t start = eeprom_stats_now();
+    if (dev->shm != NULL)
+    {
+        int e = eeprom_shm_lock(dev->shm);
+        if (e < 0)
+        {
+            return e;
+        }
+        e = shm_repair(dev);
+        if (e < 0)
+        {
+            pthread_mutex_unlock(&dev->shm->mutex);
+            return e;
+        }
+    }
+    else if (dev->lock != NULL)
+    {
+        eeprom_lock_range(dev->lock, addr, (len > 0) ? len : 1, write);
+    }
+    else
+    {
+        pthread_mutex_lock((pthread_mutex_t*)(dev->mutex));
+    }
+    *acquired = eeprom_stats_now();
+    eeprom_stats_add(&dev->stats->lock_wait_ns, *acquired - start);
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// unlock_range
+//
+// Releases the device lock taken by lock_range.
+//----------------------------------------------------------
+// @param[in]  : dev      - process independent device struct
+// @param[in]  : addr     - effective device address
+// @param[in]  : len      - number of bytes
+// @param[in]  : acquired - lock_range return value
+//
+static void unlock_range(eeprom_dev_t *dev, uint32_t addr, uint32_t len,
+    uint64_t acquired)
+{
+    eeprom_stats_add(&dev->stats->lock_hold_ns, eeprom_stats_now() - acquired);
+    if (dev->shm != NULL)
+    {
+        pthread_mutex_unlock(&dev->shm->mutex);
+    }
+    else if (dev->lock != NULL)
+    {
+        eeprom_unlock_range(dev->lock, addr, (len > 0) ? len : 1);
+    }
+    else
+    {
+        pthread_mutex_unlock((pthread_mutex_t*)(dev->mutex));
+    }
+}
+
+//----------------------------------------------------------
+// retry_wait
+//
+// Applies dev->retry after a failed transaction attempt: waits
+// out the backoff and returns nonzero when another attempt
+// should be made.
+//----------------------------------------------------------
+// @param[in]  : dev     - process independent device struct
+// @param[in]  : e       - error of the failed attempt
+// @param[in]  : attempt - attempts made so far
+// @param[in]  : first   - start of the first attempt
+// @param[out] : int     - nonzero to try again
+//
+static int retry_wait(eeprom_dev_t *dev, int e, uint32_t attempt, uint64_t first)
+{
+    //bad addresses and arguments fail the same way every time
+    if ((e == -EFAULT) || (e == -ENODEV) || (e == -EINVAL) || (e == -ENOMEM) ||
+        (attempt >= dev->retry.attempts))
+    {
+        return 0;
+    }
+    const uint32_t shift = (attempt - 1 < 20) ? attempt - 1 : 20;
+    const uint64_t wait  = (uint64_t)dev->retry.backoff_us * 1000 << shift;
+    if (dev->retry.deadline_us &&
+        (eeprom_stats_now() + wait - first > (uint64_t)dev->retry.deadline_us * 1000))
+    {
+        return 0;
+    }
+    if (wait)
+    {
+        struct timespec ts = { wait / 1000000000, wait % 1000000000 };
+        while (nanosleep(&ts, &ts) < 0)
+        {
+            //interrupted, sleep the remainder
+        }
+    }
+    eeprom_stats_add(&dev->stats->retries, 1);
+    return 1;
+}
+
+//----------------------------------------------------------
+// ack_poll
+//
+// Paces ACK polling after a transaction the part did not
+// acknowledge, yielding the CPU between polls. A part in its
+// write cycle acknowledges within one tWR of the first refusal,
+// so polling stops once a poll begun after that is refused too,
+// at once for an untimed part, or when dev->retry's deadline has
+// passed; the attempt has then failed.
+//----------------------------------------------------------
+// @param[in]  : dev   - process independent device struct
+// @param[in]  : since - time of the first refusal
+// @param[in]  : tried - start of the poll just refused
+// @param[in]  : first - start of the first attempt
+// @param[out] : int   - nonzero to poll again
+//
+static int ack_poll(eeprom_dev_t *dev, uint64_t since, uint64_t tried, uint64_t first)
+{
+    const uint64_t now = eeprom_stats_now();
+    const uint64_t twr = eeprom_device_write_cycle(dev->hw);
+    if ((twr == 0) || (tried > since + twr) ||
+        (dev->retry.deadline_us && (now - first > (uint64_t)dev->retry.deadline_us * 1000)))
+    {
+        return 0;
+    }
+    eeprom_stats_add(&dev->stats->ack_polls, 1);
+    sched_yield();
+    return 1;
+}
+
+//----------------------------------------------------------
+// device_write_page
+//
+// Counted hardware tier page write. ACK-polls while the part
+// is busy finishing a previous write cycle and retries failures,
+// a part that never acknowledges among them, under dev->retry.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : buf  - bytes to write
+// @param[in]  : len  - number of bytes, within one page
+// @param[out] : int  - 0 on success
+//
+static int device_write_page(eeprom_dev_t *dev, uint32_t addr, const char *buf, int len)
+{
+    const uint64_t first   = eeprom_stats_now();
+    uint32_t       attempt = 0;
+    int            e;
+    do
+    {
+        const uint64_t start = eeprom_stats_now();
+        uint64_t       tried = start;
+        uint64_t       since = 0;
+        while ((e = eeprom_device_write_page(dev->hw, addr, buf, len)) == -EAGAIN)
+        {
+            //part busy in its write cycle
+            since = since ? since : eeprom_stats_now();
+            if (!ack_poll(dev, since, tried, first))
+            {
+                break;
+            }
+            tried = eeprom_stats_now();
+        }
+        e = (e == -EAGAIN) ? -ETIMEDOUT : e;
+        eeprom_stats_add(&dev->stats->device_calls, 1);
+        eeprom_stats_latency(dev->stats->attempt_latency, eeprom_stats_now() - start);
+    } while ((e < 0) && retry_wait(dev, e, ++attempt, first));
+    eeprom_stats_add((e < 0) ? &dev->stats->device_errors :
+        &dev->stats->page_programs, 1);
+    return e;
+}
+
+//----------------------------------------------------------
+// bank_span
+//
+// Bytes of [addr, addr+len) before the next bank boundary.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : len  - number of bytes
+// @param[out] : uint32_t - bytes within addr's bank
+//
+static uint32_t bank_span(eeprom_dev_t *dev, uint32_t addr, uint32_t len)
+{
+    const uint32_t bank = dev->properties.bank_size_words;
+    if (bank == 0)
+    {
+        return len;
+    }
+    const uint32_t room = bank - addr % bank;
+    return (len < room) ? len : room;
+}
+
+//----------------------------------------------------------
+// block_span
+//
+// Bytes of [addr, addr+len) before the next bank or block
+// boundary, the most one transaction can address.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : len  - number of bytes
+// @param[out] : uint32_t - bytes within addr's block
+//
+static uint32_t block_span(eeprom_dev_t *dev, uint32_t addr, uint32_t len)
+{
+    const uint32_t block = dev->properties.block_size_words;
+    len = bank_span(dev, addr, len);
+    if (block == 0)
+    {
+        return len;
+    }
+    const uint32_t room = block - addr % block;
+    return (len < room) ? len : room;
+}
+
+//----------------------------------------------------------
+// device_read_bank
+//
+// Counted hardware tier sequential read within one bank.
+// ACK-polls while the part is busy finishing a write cycle and
+// retries failures, as device_write_page does.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : buf  - destination buffer
+// @param[in]  : len  - number of bytes
+// @param[out] : int  - 0 on success
+//
+static int device_read_bank(eeprom_dev_t *dev, uint32_t addr, char *buf, int len)
+{
+    const uint64_t first   = eeprom_stats_now();
+    uint32_t       attempt = 0;
+    int            e;
+    do
+    {
+        const uint64_t start = eeprom_stats_now();
+        uint64_t       tried = start;
+        uint64_t       since = 0;
+        while ((e = eeprom_device_read_range(dev->hw, addr, buf, len)) == -EAGAIN)
+        {
+            //part busy in its write cycle
+            since = since ? since : eeprom_stats_now();
+            if (!ack_poll(dev, since, tried, first))
+            {
+                break;
+            }
+            tried = eeprom_stats_now();
+        }
+        e = (e == -EAGAIN) ? -ETIMEDOUT : e;
+        eeprom_stats_add(&dev->stats->device_calls, 1);
+        eeprom_stats_latency(dev->stats->attempt_latency, eeprom_stats_now() - start);
+    } while ((e < 0) && retry_wait(dev, e, ++attempt, first));
+    if (e < 0)
+    {
+        eeprom_stats_add(&dev->stats->device_errors, 1);
+    }
+    return e;
+}
+
+//----------------------------------------------------------
+// device_read_range
+//
+// Counted hardware tier read of any range. A sequential read
+// rolls over at the end of its bank or block, so a range
+// spanning them is read one block at a time. The banks share one
+// bus, so there is nothing to overlap and the reads run in order.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : buf  - destination buffer
+// @param[in]  : len  - number of bytes
+// @param[out] : int  - 0 on success
+//
+static int device_read_range(eeprom_dev_t *dev, uint32_t addr, char *buf, int len)
+{
+    int e = 0;
+    while ((len > 0) && (e == 0))
+    {
+        const uint32_t n = block_span(dev, addr, len);
+        e     = device_read_bank(dev, addr, buf, n);
+        addr += n;
+        buf  += n;
+        len  -= n;
+    }
+    return e;
+}
+
+//----------------------------------------------------------
+// map_generation
+//
+// Current generation of a mapped range, from the shadow's page
+// sequence counts or else the image's write count.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : map  - mapped range
+// @param[in]  : gen  - receives generation
+// @param[out] : int  - nonzero while a write is in progress
+//
+static int map_generation(eeprom_dev_t *dev, const eeprom_map_t *map, uint64_t *gen)
+{
+    if (dev->cache != NULL)
+    {
+        return eeprom_cache_generation(dev->cache, map->addr, map->size, gen);
+    }
+    *gen = eeprom_device_generation(dev->hw);
+    return *gen & 1;
+}
+
+//----------------------------------------------------------
+// flush_page_cb
+//
+// eeprom_cache_flush page write, arg is the device struct.
+//----------------------------------------------------------
+// @param[in]  : arg  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : buf  - bytes to write
+// @param[in]  : len  - number of bytes, within one page
+// @param[out] : int  - 0 on success
+//
+static int flush_page_cb(void *arg, uint32_t addr, const char *buf, int len)
+{
+    return device_write_page((eeprom_dev_t*)arg, addr, buf, len);
+}
+
+//----------------------------------------------------------
+// flush_timer_cb
+//
+// eeprom_cache_start_timer callback, arg is the device struct.
+//----------------------------------------------------------
+// @param[in]  : arg - process independent device struct
+// @param[out] : int - 0 on success
+//
+static int flush_timer_cb(void *arg)
+{
+    return eeprom_flush((eeprom_dev_t*)arg);
+}
+
 //----------------------------------------------------------
 // check_input_errors
 //
@@ -92,7 +484,7 @@ int check_input_errors(eeprom_dev_t *dev, uint32_t offset, int size, char * buf)
         return -ENODEV;
     }
     //device specified, fields unspecified
-    if (!(dev->mutex && dev->fault_handler))
+    if (!((dev->mutex || dev->lock || dev->shm_name) && dev->fault_handler))
     {
         return -EINVAL;
     }
@@ -110,128 +502,1424 @@ int check_input_errors(eeprom_dev_t *dev, uint32_t offset, int size, char * buf)
     return 0; //success
 }
 
+//----------------------------------------------------------
+// release_state
+//
+// Frees driver owned state of dev and drops its hardware tier
+// reference. Safe on partially opened devices.
+//----------------------------------------------------------
+// @param[in]  : dev - process independent device struct
+// @param[out] : int - hardware tier close result
+//
+static int release_state(eeprom_dev_t *dev)
+{
+    int e = 0;
+    if (dev->cache != NULL)
+    {
+        eeprom_cache_destroy(dev->cache);
+        eeprom_device_release_shadow(dev->hw);
+        dev->cache = NULL;
+    }
+    if (dev->hw != NULL)
+    {
+        e = eeprom_device_close(dev->hw);
+        dev->hw = NULL;
+    }
+    if (dev->shm != NULL)
+    {
+        //counters live in the segment
+        eeprom_shm_detach(dev->shm_name, dev->shm);
+        dev->shm = NULL;
+    }
+    else
+    {
+        free(dev->stats);
+    }
+    dev->stats = NULL;
+    return e;
+}
+
 //Public specification in header
-int eeprom_write(eeprom_dev_t *dev, uint32_t offset, int size, char * buf)
+int eeprom_open(eeprom_dev_t *dev)
 {
     //scrub user input
-    int e = check_input_errors(dev, offset, size, buf);
+    int e = check_input_errors(dev, 0, 0, NULL);
     if (e < 0)
     {
         return e;
     }
 
-    //write loop variables
-    uint32_t write_size;          //current number of bytes to write
-    uint32_t page;                //page counter
-    uint32_t cur_addr;            //current address during transaction
-    uint32_t total_byte_counter;  //counter across entire buffer
-    uint8_t  page_byte_counter;   //byte transmission counter 0-32
-    int      result;              //error code or succcessful transmission
-    char     err[1024];           //string holding fault handler error
+    //checksums and the journal are kept per process, so another
+    //process's writes would leave them stale
+    if ((dev->shm_name != NULL) && (dev->flags & (EEPROM_F_CRC | EEPROM_F_JOURNAL)))
+    {
+        return -EINVAL;
+    }
 
-    //calculate effective address from base, check boundaries
-    const uint8_t  page_size_bytes   = dev->properties.page_size_bytes;
-    const uint32_t device_size_words = dev->properties.device_size_words;
-    const uint32_t base_addr         = dev->properties.base_address;
-    const uint32_t effective_addr    = base_addr + offset;
-    //memory should be zero-indexed: [base, words-1]
-    if ((effective_addr < base_addr) || (effective_addr > device_size_words-1))
+    dev->hw    = NULL;
+    dev->async = NULL;
+    dev->cache = NULL;
+    dev->maps  = 0;
+    dev->shm   = NULL;
+    if (eeprom_geom_init(&dev->geom, dev->properties.page_size_bytes) < 0)
     {
-        snprintf(err, sizeof(err), "Bad address %i, bounds are [%i, %i]",
-            effective_addr, base_addr, device_size_words-1);
-        dev->fault_handler(err);
+        return -EINVAL; //page size this build cannot address
+    }
+    if (dev->shm_name != NULL)
+    {
+        e = eeprom_shm_attach(dev->shm_name, dev->properties.device_size_words,
+            dev->properties.page_size_bytes, (dev->flags & EEPROM_F_CACHE) != 0,
+            &dev->shm);
+        if (e < 0)
+        {
+            dev->shm = NULL;
+            return e;
+        }
+        dev->stats = &dev->shm->stats;
+    }
+    else
+    {
+        dev->stats = calloc(1, sizeof(eeprom_stats_t));
+        if (dev->stats == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+    e = eeprom_device_open(dev->image_path, dev->backend, &dev->hw);
+    if (e < 0)
+    {
+        dev->hw = NULL;
+        release_state(dev);
+        return e;
+    }
+    //image must cover every word described by properties, and
+    //agree on page size when its format records one
+    const int image_page = eeprom_device_page_size(dev->hw);
+    if ((eeprom_device_size(dev->hw) < dev->properties.device_size_words) ||
+        (image_page && (image_page != dev->properties.page_size_bytes)))
+    {
+        release_state(dev);
+        return -EINVAL;
     }
 
-    //calculate remaining space available in page
-    //variables holding data transaction sizes
-    uint32_t page_space  =
-        (((effective_addr/page_size_bytes) + 1)*page_size_bytes) - effective_addr;
-    uint32_t first_write_size = calc_first_write(size, page_space);
-    uint32_t total_num_writes = calc_total_writes(size, first_write_size, page_size_bytes);
-    uint32_t last_write_size  = calc_last_write(size, first_write_size, page_size_bytes);
+    if (dev->timing.clock_hz)
+    {
+        eeprom_device_set_timing(dev->hw, &dev->timing);
+    }
 
-    //start page access transmissions
-    cur_addr = effective_addr;
-    total_byte_counter = 0;
+    //banks and blocks hold whole pages, so no page write crosses
+    //one, and a bank holds whole blocks
+    const uint32_t block = dev->properties.block_size_words;
+    if (eeprom_geom_offset(&dev->geom, block) ||
+        (block && (dev->properties.bank_size_words % block)))
+    {
+        release_state(dev);
+        return -EINVAL;
+    }
+    if (dev->properties.bank_size_words)
+    {
+        e = eeprom_geom_offset(&dev->geom, dev->properties.bank_size_words) ? -EINVAL :
+            eeprom_device_set_banks(dev->hw, dev->properties.bank_size_words);
+        if (e < 0)
+        {
+            release_state(dev);
+            return e;
+        }
+    }
 
-    //lock reentrant code protecting shared resource
-    pthread_mutex_lock((pthread_mutex_t*)(dev->mutex));
-    for (page = 0; page < total_num_writes; page++)
+    if (dev->flags & EEPROM_F_CRC)
     {
-        if (page == 0)                         //first page
+        e = eeprom_device_enable_crc(dev->hw, dev->properties.page_size_bytes);
+        if (e < 0)
         {
-            write_size = first_write_size;
+            release_state(dev);
+            return e;
         }
-        else if (page == (total_num_writes-1)) //last page
+    }
+
+    if (dev->flags & EEPROM_F_CACHE)
+    {
+        //device structs sharing the image must share its shadow,
+        //which only views of one segment do
+        e = eeprom_device_claim_shadow(dev->hw,
+            (dev->shm != NULL) ? (const void*)&shm_shadow_owner : (const void*)dev);
+        if (e < 0)
         {
-            write_size = last_write_size;
+            release_state(dev);
+            return e;
         }
-        else                                   //intermediate page
+        if (dev->shm != NULL)
         {
-            write_size = page_size_bytes;
+            //first process to get here fills the shared shadow
+            e = eeprom_shm_lock(dev->shm);
+            if (e < 0)
+            {
+                eeprom_device_release_shadow(dev->hw);
+                release_state(dev);
+                return e;
+            }
+            dev->cache = eeprom_cache_attach(dev->hw, dev->properties.device_size_words,
+                dev->properties.page_size_bytes, dev->flags & EEPROM_F_ELIDE,
+                &dev->stats->ack_polls, eeprom_shm_shadow(dev->shm), !dev->shm->warm);
+            dev->shm->warm |= (dev->cache != NULL);
+            e = (dev->cache != NULL) ? shm_repair(dev) : 0;
+            pthread_mutex_unlock(&dev->shm->mutex);
+            if (e < 0)
+            {
+                release_state(dev);
+                return e;
+            }
         }
-
-        page_byte_counter = 0;
-        while (page_byte_counter < write_size)
+        else
+        {
+            dev->cache = eeprom_cache_create(dev->hw, dev->properties.device_size_words,
+                dev->properties.page_size_bytes, dev->flags & EEPROM_F_ELIDE,
+                &dev->stats->ack_polls);
+        }
+        if (dev->cache == NULL)
         {
-            //For typical page accesses, address would be sent once over i2c
-            //followed by a serial stream of byte data. But here, address is
-            //being incremented since eeprom file i/o device doesn't hold state.
-            result = eeprom_device_write(cur_addr, buf[total_byte_counter]);
-            if (result < 0)
+            eeprom_device_release_shadow(dev->hw);
+            release_state(dev);
+            return -ENOMEM;
+        }
+        if (dev->cache_flush_ms)
+        {
+            e = eeprom_cache_start_timer(dev->cache, flush_timer_cb, dev,
+                dev->cache_flush_ms);
+            if (e < 0)
             {
-                pthread_mutex_unlock((pthread_mutex_t*)(dev->mutex));
-                snprintf(err, sizeof(err),
-                    "Failed transmission on byte %i", total_byte_counter);
-                dev->fault_handler(err);
+                release_state(dev);
+                return e;
             }
-            page_byte_counter++;
-            total_byte_counter++;
-            cur_addr++;
         }
     }
-    pthread_mutex_unlock((pthread_mutex_t*)(dev->mutex));
 
     return 0; //success
 }
 
 //Public specification in header
-int eeprom_read(eeprom_dev_t *dev, uint32_t offset, int size, char * buf)
+int eeprom_flush(eeprom_dev_t *dev)
 {
-    //scrub user input
-    int e = check_input_errors(dev, offset, size, buf);
-    if (e < 0)
+    if (dev == NULL)
     {
-        return e;
+        return -ENODEV;
     }
-    //read loop variables
-    int  byte_counter; //current byte being read
-    char err[1024];   //string holding fault handler error
-
-    //calculate effective address from base, check boundaries
-    const uint32_t device_size_words = dev->properties.device_size_words;
-    const uint32_t base_addr         = dev->properties.base_address;
-    const uint32_t effective_addr    = base_addr + offset;
-    if ((effective_addr < base_addr) || (effective_addr > device_size_words-1))
+    if (dev->cache == NULL)
     {
-        snprintf(err, sizeof(err),
-            "Bad offset address, bounds are [%i, %i]", base_addr, device_size_words-1);
-        dev->fault_handler(err);
+        return 0; //nothing buffered
     }
 
-    //lock reentrant code protecting shared resource
-    pthread_mutex_lock((pthread_mutex_t*)(dev->mutex));
-    for (byte_counter = 0; byte_counter < size; byte_counter++)
+    const uint32_t size_words = dev->properties.device_size_words;
+    uint64_t acquired;
+    int      e = lock_range(dev, 0, size_words, 1, &acquired);
+    if (e < 0)
     {
-        int res = eeprom_device_read(effective_addr+byte_counter, &buf[byte_counter]);
+        return e;
+    }
+    //page writes are counted by device_write_page
+    e = eeprom_cache_flush(dev->cache, flush_page_cb, dev);
+    unlock_range(dev, 0, size_words, acquired);
+    return (e < 0) ? e : 0;
+}
+
+//Public specification in header
+int eeprom_sync(eeprom_dev_t *dev)
+{
+    int e = eeprom_flush(dev);
+    if (e < 0)
+    {
+        return e;
+    }
+    e = eeprom_device_sync(dev->hw);
+    if (e < 0)
+    {
+        eeprom_stats_add(&dev->stats->device_errors, 1);
+    }
+    return e;
+}
+
+//Public specification in header
+int eeprom_get_stats(eeprom_dev_t *dev, eeprom_stats_t *stats)
+{
+    if (dev == NULL)
+    {
+        return -ENODEV;
+    }
+    if ((stats == NULL) || (dev->stats == NULL))
+    {
+        return -EINVAL;
+    }
+    eeprom_stats_snapshot(dev->stats, stats);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_close(eeprom_dev_t *dev)
+{
+    if (dev == NULL)
+    {
+        return -ENODEV;
+    }
+    if (__atomic_load_n(&dev->maps, __ATOMIC_ACQUIRE) > 0)
+    {
+        return -EBUSY; //shadow or image still referenced
+    }
+    eeprom_async_stop(dev);
+    int e = eeprom_flush(dev);
+    int c = release_state(dev);
+    return (e < 0) ? e : c;
+}
+
+//----------------------------------------------------------
+// program_page
+//
+// Issues one page write transaction for len bytes at addr, all
+// within one page. Given the page's current contents, only the
+// changed bytes are programmed, or none when nothing changed.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : len  - number of bytes, at least one
+// @param[in]  : buf  - data buffer
+// @param[in]  : cur  - current contents of the range, may be NULL
+// @param[out] : int  - 0 on success
+//
+static int program_page(eeprom_dev_t *dev, uint32_t addr, uint32_t len,
+    const char *buf, const char *cur)
+{
+    uint32_t lo = 0;
+    uint32_t hi = len - 1;
+    if ((cur != NULL) && !eeprom_diff_span(buf, cur, len, &lo, &hi))
+    {
+        eeprom_stats_add(&dev->stats->pages_elided, 1);
+        return 0;
+    }
+
+    //address is sent once followed by the page's serial stream
+    //of byte data, as in a typical i2c page write
+    return device_write_page(dev, addr + lo, buf + lo, hi - lo + 1);
+}
+
+//----------------------------------------------------------
+// program_pages
+//
+// Splits [addr, addr+size) at page boundaries and issues one
+// page write transaction per page touched. With EEPROM_F_ELIDE
+// the range is first read back in one transaction; unchanged
+// pages are skipped and the rest shrunk to their changed bytes.
+// Caller holds the device lock for the range.
+//----------------------------------------------------------
+// @param[in]  : dev     - process independent device struct
+// @param[in]  : addr    - effective device address
+// @param[in]  : size    - number of bytes to write
+// @param[in]  : buf     - data buffer
+// @param[in]  : written - bytes programmed before any failure
+// @param[out] : int     - 0 on success
+//
+static int program_pages(eeprom_dev_t *dev, uint32_t addr, int size,
+    const char *buf, uint32_t *written)
+{
+    //write loop variables
+    uint32_t write_size;          //current number of bytes to write
+    uint32_t page;                //page counter
+    uint32_t cur_addr;            //current address during transaction
+    uint32_t total_byte_counter;  //counter across entire buffer
+    int      result;              //error code or succcessful transmission
+
+    //calculate remaining space available in page
+    //variables holding data transaction sizes
+    const uint32_t page_size_bytes = dev->geom.page;
+    uint32_t page_space  = page_size_bytes - eeprom_geom_offset(&dev->geom, addr);
+    uint32_t first_write_size = calc_first_write(size, page_space);
+    uint32_t total_num_writes = calc_total_writes(size, first_write_size, &dev->geom);
+    uint32_t last_write_size  = calc_last_write(size, first_write_size, &dev->geom);
+
+    //current contents to compare against, one sequential read
+    char *cur = NULL;
+    if (dev->flags & EEPROM_F_ELIDE)
+    {
+        cur = malloc(size);
+        if (cur == NULL)
+        {
+            *written = 0;
+            return -ENOMEM;
+        }
+        result = device_read_range(dev, addr, cur, size);
+        if (result < 0)
+        {
+            free(cur);
+            *written = 0;
+            return result;
+        }
+    }
+
+    //start page access transmissions
+    cur_addr = addr;
+    total_byte_counter = 0;
+    for (page = 0; page < total_num_writes; page++)
+    {
+        if (page == 0)                         //first page
+        {
+            write_size = first_write_size;
+        }
+        else if (page == (total_num_writes-1)) //last page
+        {
+            write_size = last_write_size;
+        }
+        else                                   //intermediate page
+        {
+            write_size = page_size_bytes;
+        }
+
+        if (write_size == 0)                   //buffer ended on page boundary
+        {
+            continue;
+        }
+
+        result = program_page(dev, cur_addr, write_size, &buf[total_byte_counter],
+            (cur != NULL) ? &cur[total_byte_counter] : NULL);
+        if (result < 0)
+        {
+            free(cur);
+            *written = total_byte_counter;
+            return result;
+        }
+        total_byte_counter += write_size;
+        cur_addr           += write_size;
+    }
+
+    free(cur);
+    *written = total_byte_counter;
+    return 0; //success
+}
+
+//Slice of one write falling in a single bank, see program_banks
+typedef struct eeprom_bank_job
+{
+    uint32_t    addr;
+    uint32_t    size;
+    const char *buf;
+    const char *cur;     //current contents, EEPROM_F_ELIDE only
+    uint32_t    written;
+    int         result;
+
+} eeprom_bank_job_t;
+
+//----------------------------------------------------------
+// program_banks
+//
+// Programs a range with program_pages. A range spanning banks
+// is split at bank boundaries and the slices' pages are issued
+// in turn, one page of every unfinished bank per round, so each
+// bank's write cycle runs while the next bank's page is sent
+// instead of the banks queuing behind each other.
+//----------------------------------------------------------
+// @param[in]  : dev     - process independent device struct
+// @param[in]  : addr    - effective device address
+// @param[in]  : size    - number of bytes
+// @param[in]  : buf     - data buffer
+// @param[in]  : written - bytes before the first failing bank
+//                         plus those it programmed; later banks
+//                         may also have been programmed
+// @param[out] : int     - 0 on success, first failing bank's error
+//
+static int program_banks(eeprom_dev_t *dev, uint32_t addr, int size,
+    const char *buf, uint32_t *written)
+{
+    if (bank_span(dev, addr, size) == size)
+    {
+        return program_pages(dev, addr, size, buf, written);
+    }
+    const uint32_t bank  = dev->properties.bank_size_words;
+    const int      count = (addr + size - 1) / bank - addr / bank + 1;
+    eeprom_bank_job_t *jobs = calloc(count, sizeof(eeprom_bank_job_t));
+    char              *cur  = (dev->flags & EEPROM_F_ELIDE) ? malloc(size) : NULL;
+    int                result = 0;
+    *written = 0;
+    if ((jobs == NULL) || ((dev->flags & EEPROM_F_ELIDE) && (cur == NULL)))
+    {
+        free(jobs);
+        free(cur);
+        return -ENOMEM;
+    }
+
+    //current contents to compare against, one read per bank
+    if (cur != NULL)
+    {
+        result = device_read_range(dev, addr, cur, size);
+        if (result < 0)
+        {
+            free(jobs);
+            free(cur);
+            return result;
+        }
+    }
+    uint32_t done = 0;
+    int      i;
+    for (i = 0; i < count; i++)
+    {
+        jobs[i].addr = addr + done;
+        jobs[i].size = bank_span(dev, addr + done, size - done);
+        jobs[i].buf  = buf + done;
+        jobs[i].cur  = (cur != NULL) ? cur + done : NULL;
+        done += jobs[i].size;
+    }
+
+    //a bank still in its write cycle is ACK-polled when its turn
+    //comes round again
+    int unfinished = count;
+    while (unfinished > 0)
+    {
+        unfinished = 0;
+        for (i = 0; i < count; i++)
+        {
+            eeprom_bank_job_t *job = &jobs[i];
+            if ((job->result < 0) || (job->written == job->size))
+            {
+                continue;
+            }
+            const uint32_t at   = job->addr + job->written;
+            const uint32_t room = dev->geom.page - eeprom_geom_offset(&dev->geom, at);
+            const uint32_t n    = (job->size - job->written < room) ?
+                job->size - job->written : room;
+            job->result = program_page(dev, at, n, job->buf + job->written,
+                (job->cur != NULL) ? job->cur + job->written : NULL);
+            if (job->result == 0)
+            {
+                job->written += n;
+                unfinished   += (job->written < job->size);
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        *written += jobs[i].written;
+        if (jobs[i].result < 0)
+        {
+            result = jobs[i].result;
+            break;
+        }
+    }
+    free(jobs);
+    free(cur);
+    return result;
+}
+
+//----------------------------------------------------------
+// program_extents
+//
+// Programs every extent with program_banks. With EEPROM_F_JOURNAL
+// a write touching more than one page is first recorded in the
+// hardware tier journal, making it atomic across a crash, and a
+// failure leaves none of it written.
+// Caller holds the device lock for every extent.
+//----------------------------------------------------------
+// @param[in]  : dev     - process independent device struct
+// @param[in]  : ext     - extents, line_num is effective address
+// @param[in]  : count   - number of extents
+// @param[in]  : failed  - index of failing extent
+// @param[in]  : written - bytes of failing extent programmed
+// @param[out] : int     - 0 on success
+//
+static int program_extents(eeprom_dev_t *dev, const eeprom_device_extent_t *ext,
+    int count, int *failed, uint32_t *written)
+{
+    int journal = 0;
+    int result  = 0;
+    int i;
+    if (dev->flags & EEPROM_F_JOURNAL)
+    {
+        //a single page write is already all or nothing
+        journal = (count > 1) || (eeprom_geom_page(&dev->geom, ext[0].line_num) !=
+            eeprom_geom_page(&dev->geom, ext[0].line_num + ext[0].len - 1));
+    }
+    if (journal)
+    {
+        result = eeprom_device_journal_begin(dev->hw, ext, count);
+        if (result < 0)
+        {
+            *failed  = 0;
+            *written = 0;
+            return result;
+        }
+    }
+    for (i = 0; (i < count) && (result == 0); i++)
+    {
+        *failed = i;
+        result  = program_banks(dev, ext[i].line_num, ext[i].len, ext[i].buf, written);
+    }
+    if (journal)
+    {
+        //a failed write is rolled back, so none of it committed,
+        //or if that fails rolled forward, so all of it did
+        int e = eeprom_device_journal_end(dev->hw, result == 0);
+        if ((result < 0) && (e == 0))
+        {
+            *failed  = 0;
+            *written = 0;
+        }
+        else if ((result < 0) && (e == 1))
+        {
+            *failed  = count - 1;
+            *written = ext[count-1].len;
+            result   = 0;
+        }
+        else if (result == 0)
+        {
+            result = e;
+        }
+    }
+    return result;
+}
+
+//Contiguous device range built from one or more iovec segments
+typedef struct eeprom_span
+{
+    uint32_t addr;   //effective device address
+    uint32_t len;    //bytes, gaps within a page included
+    uint32_t stage;  //offset of span in staging buffer
+
+} eeprom_span_t;
+
+//qsort context is not reentrant, so sort (offset, index) pairs
+typedef struct eeprom_seg_key
+{
+    uint32_t addr;
+    int      index;
+
+} eeprom_seg_key_t;
+
+//----------------------------------------------------------
+// cmp_seg_key
+//
+// qsort comparator: ascending address, then submission order.
+//----------------------------------------------------------
+static int cmp_seg_key(const void *a, const void *b)
+{
+    const eeprom_seg_key_t *x = a;
+    const eeprom_seg_key_t *y = b;
+    if (x->addr != y->addr)
+    {
+        return (x->addr > y->addr) - (x->addr < y->addr);
+    }
+    return x->index - y->index;
+}
+
+//----------------------------------------------------------
+// build_spans
+//
+// Checks every segment against device bounds, sorts them by
+// address and merges segments that overlap, touch, or leave
+// only a gap inside one page into spans. Each merged span is
+// then a single page walk, so no page is transacted twice.
+// The in-page gaps merged into spans are optionally returned
+// too, staged at their place within their span.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : iov    - segments
+// @param[in]  : iovcnt - number of segments
+// @param[in]  : spans  - receives malloc'd span array
+// @param[in]  : staged - receives total staging bytes
+// @param[in]  : gaps   - receives malloc'd gap array, may be NULL
+// @param[in]  : ngaps  - receives number of gaps
+// @param[out] : int    - number of spans, negative on error
+//
+static int build_spans(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt,
+    eeprom_span_t **spans, uint32_t *staged, eeprom_span_t **gaps, int *ngaps)
+{
+    const uint32_t device_size_words = dev->properties.device_size_words;
+    const uint32_t base_addr         = dev->properties.base_address;
+    char           err[1024];
+    int            i;
+
+    eeprom_seg_key_t *keys = malloc(iovcnt * sizeof(eeprom_seg_key_t));
+    eeprom_span_t    *out  = malloc(iovcnt * sizeof(eeprom_span_t));
+    eeprom_span_t    *hole = (gaps != NULL) ? malloc(iovcnt * sizeof(eeprom_span_t)) : NULL;
+    if ((keys == NULL) || (out == NULL) || ((gaps != NULL) && (hole == NULL)))
+    {
+        free(keys);
+        free(out);
+        free(hole);
+        return -ENOMEM;
+    }
+    for (i = 0; i < iovcnt; i++)
+    {
+        const uint32_t effective_addr = base_addr + iov[i].offset;
+        if ((effective_addr < base_addr) || (effective_addr > device_size_words-1) ||
+            (iov[i].len < 0) || (iov[i].len > device_size_words - effective_addr) ||
+            ((iov[i].len > 0) && (iov[i].buf == NULL)))
+        {
+            free(keys);
+            free(out);
+            free(hole);
+            snprintf(err, sizeof(err), "Bad segment %i address %i, bounds are [%i, %i]",
+                i, effective_addr, base_addr, device_size_words-1);
+            dev->fault_handler(err);
+            return -EFAULT;
+        }
+        keys[i].addr  = effective_addr;
+        keys[i].index = i;
+    }
+    qsort(keys, iovcnt, sizeof(eeprom_seg_key_t), cmp_seg_key);
+
+    int      n     = 0;
+    int      m     = 0;
+    uint32_t total = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+        const uint32_t addr = keys[i].addr;
+        const uint32_t end  = addr + iov[keys[i].index].len;
+        if (end == addr)
+        {
+            continue; //empty segment
+        }
+        if (n > 0)
+        {
+            eeprom_span_t *cur     = &out[n-1];
+            uint32_t       cur_end = cur->addr + cur->len;
+            if ((addr <= cur_end) ||
+                (eeprom_geom_page(&dev->geom, addr) ==
+                 eeprom_geom_page(&dev->geom, cur_end - 1)))
+            {
+                if ((addr > cur_end) && (hole != NULL))
+                {
+                    hole[m].addr  = cur_end;
+                    hole[m].len   = addr - cur_end;
+                    hole[m].stage = cur->stage + cur->len;
+                    m++;
+                }
+                if (end > cur_end)
+                {
+                    total    += end - cur_end;
+                    cur->len  = end - cur->addr;
+                }
+                continue;
+            }
+        }
+        out[n].addr  = addr;
+        out[n].len   = end - addr;
+        out[n].stage = total;
+        total += out[n].len;
+        n++;
+    }
+    free(keys);
+
+    *spans  = out;
+    *staged = total;
+    if (gaps != NULL)
+    {
+        *gaps  = hole;
+        *ngaps = m;
+    }
+    return n;
+}
+
+//----------------------------------------------------------
+// find_span
+//
+// Binary search for the span containing addr.
+//----------------------------------------------------------
+// @param[in]  : spans - ascending, disjoint spans
+// @param[in]  : n     - number of spans
+// @param[in]  : addr  - effective device address
+// @param[out] : eeprom_span_t* - containing span
+//
+static eeprom_span_t *find_span(eeprom_span_t *spans, int n, uint32_t addr)
+{
+    int lo = 0;
+    int hi = n - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (spans[mid].addr <= addr)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return &spans[lo];
+}
+
+//----------------------------------------------------------
+// read_span
+//
+// Reads [addr, addr+len) from cache or device. Caller holds
+// the device lock for the range.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : buf  - destination buffer
+// @param[in]  : len  - number of bytes
+// @param[out] : int  - 0 on success
+//
+static int read_span(eeprom_dev_t *dev, uint32_t addr, char *buf, uint32_t len)
+{
+    if (dev->cache != NULL)
+    {
+        int r = eeprom_cache_read(dev->cache, addr, buf, len);
+        return (r < 0) ? r : 0;
+    }
+    return device_read_range(dev, addr, buf, len);
+}
+
+//----------------------------------------------------------
+// cache_read
+//
+// Lock free copy out of the shadow, see eeprom_cache_read. A
+// range held too long by a writer is copied under the device
+// lock instead, which waits for a live writer and repairs what
+// a dead one left.
+//----------------------------------------------------------
+// @param[in]  : dev  - process independent device struct
+// @param[in]  : addr - effective device address
+// @param[in]  : buf  - destination buffer
+// @param[in]  : len  - number of bytes
+// @param[out] : int  - 0 on success
+//
+static int cache_read(eeprom_dev_t *dev, uint32_t addr, char *buf, uint32_t len)
+{
+    int r = eeprom_cache_read(dev->cache, addr, buf, len);
+    if (r == -EAGAIN)
+    {
+        uint64_t acquired;
+        r = lock_range(dev, addr, len, 0, &acquired);
+        if (r < 0)
+        {
+            return r;
+        }
+        r = eeprom_cache_read(dev->cache, addr, buf, len);
+        unlock_range(dev, addr, len, acquired);
+    }
+    if (r < 0)
+    {
+        return r;
+    }
+    eeprom_stats_add(&dev->stats->seq_retries, r);
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// write_segments
+//
+// eeprom_writev body, also the eeprom_sched_t commit function:
+// merges segments into spans, then fills in-page gaps and
+// programs every span under one lock acquisition. Reports
+// failures to the fault handler. Records no call statistics.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : iov    - segments, later ones win on overlap
+// @param[in]  : iovcnt - number of segments, at least one
+// @param[out] : int    - 0 on success
+//
+static int write_segments(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt)
+{
+    char           err[1024];
+    eeprom_span_t *spans;
+    uint32_t       staged;
+    eeprom_span_t *gaps = NULL;
+    int            ngaps;
+    int            n = build_spans(dev, iov, iovcnt, &spans, &staged, &gaps, &ngaps);
+    if (n <= 0)
+    {
+        free(gaps);
+        return n;
+    }
+    char *stage = malloc(staged);
+    if (stage == NULL)
+    {
+        free(spans);
+        free(gaps);
+        return -ENOMEM;
+    }
+
+    const uint32_t lo = spans[0].addr;
+    const uint32_t hi = spans[n-1].addr + spans[n-1].len;
+    uint64_t acquired;
+    int      result = lock_range(dev, lo, hi - lo, 1, &acquired);
+    if (result < 0)
+    {
+        snprintf(err, sizeof(err), "Failed to lock vector write at address %i", lo);
+        free(stage);
+        free(spans);
+        free(gaps);
+        dev->fault_handler(err);
+        return result;
+    }
+
+    //fill in-page gaps with current contents, then lay segments
+    //over the rest in submission order so later segments win
+    int      i;
+    uint32_t written = 0;
+    for (i = 0; (i < ngaps) && (result == 0); i++)
+    {
+        result = read_span(dev, gaps[i].addr, stage + gaps[i].stage, gaps[i].len);
+    }
+    free(gaps);
+    for (i = 0; (i < iovcnt) && (result == 0); i++)
+    {
+        if (iov[i].len == 0)
+        {
+            continue;
+        }
+        const uint32_t       addr = dev->properties.base_address + iov[i].offset;
+        const eeprom_span_t *span = find_span(spans, n, addr);
+        memcpy(stage + span->stage + (addr - span->addr), iov[i].buf, iov[i].len);
+    }
+    int failed = 0;
+    if ((result == 0) && (dev->cache != NULL))
+    {
+        for (i = 0; i < n; i++)
+        {
+            eeprom_stats_add(&dev->stats->pages_elided,
+                eeprom_cache_write(dev->cache, spans[i].addr,
+                    stage + spans[i].stage, spans[i].len));
+        }
+    }
+    else if (result == 0)
+    {
+        eeprom_device_extent_t *ext = malloc(n * sizeof(eeprom_device_extent_t));
+        if (ext == NULL)
+        {
+            result = -ENOMEM;
+        }
+        for (i = 0; (i < n) && (ext != NULL); i++)
+        {
+            ext[i].line_num = spans[i].addr;
+            ext[i].len      = spans[i].len;
+            ext[i].buf      = stage + spans[i].stage;
+        }
+        if (ext != NULL)
+        {
+            result = program_extents(dev, ext, n, &failed, &written);
+        }
+        free(ext);
+    }
+    unlock_range(dev, lo, hi - lo, acquired);
+    free(stage);
+    if (result < 0)
+    {
+        snprintf(err, sizeof(err), "Failed vector write at address %i",
+            spans[failed].addr + written);
+        free(spans);
+        dev->fault_handler(err);
+        return result;
+    }
+    free(spans);
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// write_locked
+//
+// Takes the device lock for the range, then absorbs the write
+// into the cache or programs it page by page.
+//----------------------------------------------------------
+// @param[in]  : dev     - process independent device struct
+// @param[in]  : addr    - effective device address, bounds checked
+// @param[in]  : size    - number of bytes to write
+// @param[in]  : buf     - data buffer
+// @param[in]  : written - bytes committed before any failure
+// @param[out] : int     - 0 on success
+//
+static int write_locked(eeprom_dev_t *dev, uint32_t addr, int size,
+    const char *buf, uint32_t *written)
+{
+    //lock reentrant code protecting shared resource
+    uint64_t acquired;
+    int      result = lock_range(dev, addr, size, 1, &acquired);
+    *written = 0;
+    if (result < 0)
+    {
+        return result;
+    }
+    *written = size;
+    if (dev->cache != NULL)
+    {
+        //absorb into shadow, pages are programmed on flush
+        eeprom_stats_add(&dev->stats->pages_elided,
+            eeprom_cache_write(dev->cache, addr, buf, size));
+    }
+    else
+    {
+        eeprom_device_extent_t ext = { addr, size, buf };
+        int                    failed;
+        result = program_extents(dev, &ext, 1, &failed, written);
+    }
+    unlock_range(dev, addr, size, acquired);
+    return result;
+}
+
+//Public specification in header
+int eeprom_write(eeprom_dev_t *dev, uint32_t offset, int size, char * buf)
+{
+    //scrub user input
+    int e = check_input_errors(dev, offset, size, buf);
+    if (e < 0)
+    {
+        return e;
+    }
+    const uint64_t start = eeprom_stats_now();
+    char err[1024];   //string holding fault handler error
+
+    //calculate effective address from base, check boundaries
+    const uint32_t device_size_words = dev->properties.device_size_words;
+    const uint32_t base_addr         = dev->properties.base_address;
+    const uint32_t effective_addr    = base_addr + offset;
+    //memory should be zero-indexed: [base, words-1]
+    if ((effective_addr < base_addr) || (effective_addr > device_size_words-1) ||
+        (size < 0) || (size > device_size_words - effective_addr))
+    {
+        snprintf(err, sizeof(err), "Bad address %i, bounds are [%i, %i]",
+            effective_addr, base_addr, device_size_words-1);
+        dev->fault_handler(err);
+        return -EFAULT;
+    }
+
+    //coalesce with concurrent writers, failures already reported
+    if ((dev->sched != NULL) && (dev->cache == NULL))
+    {
+        e = eeprom_sched_write(dev->sched, dev, offset, size, buf, write_segments);
+        if (e < 0)
+        {
+            return e;
+        }
+        eeprom_stats_add(&dev->stats->writes, 1);
+        eeprom_stats_add(&dev->stats->bytes_written, size);
+        eeprom_stats_latency(dev->stats->write_latency, eeprom_stats_now() - start);
+        return 0; //success
+    }
+
+    uint32_t written;
+    int      result = write_locked(dev, effective_addr, size, buf, &written);
+    if (result < 0)
+    {
+        snprintf(err, sizeof(err), "Failed transmission on byte %i", written);
+        dev->fault_handler(err);
+        return result;
+    }
+
+    eeprom_stats_add(&dev->stats->writes, 1);
+    eeprom_stats_add(&dev->stats->bytes_written, size);
+    eeprom_stats_latency(dev->stats->write_latency, eeprom_stats_now() - start);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_write_partial(eeprom_dev_t *dev, uint32_t offset, int size,
+    const char *buf, int *committed)
+{
+    //scrub user input
+    int e = check_input_errors(dev, offset, size, NULL);
+    if (e < 0)
+    {
+        return e;
+    }
+    if ((buf == NULL) || (committed == NULL))
+    {
+        return -EINVAL;
+    }
+    const uint64_t start = eeprom_stats_now();
+    char err[1024];   //string holding fault handler error
+    *committed = 0;
+
+    //calculate effective address from base, check boundaries
+    const uint32_t device_size_words = dev->properties.device_size_words;
+    const uint32_t base_addr         = dev->properties.base_address;
+    const uint32_t effective_addr    = base_addr + offset;
+    if ((effective_addr < base_addr) || (effective_addr > device_size_words-1) ||
+        (size < 0) || (size > device_size_words - effective_addr))
+    {
+        snprintf(err, sizeof(err), "Bad address %i, bounds are [%i, %i]",
+            effective_addr, base_addr, device_size_words-1);
+        dev->fault_handler(err);
+        return -EFAULT;
+    }
+
+    //device failures are the caller's to handle
+    uint32_t written;
+    e = write_locked(dev, effective_addr, size, buf, &written);
+    *committed = written;
+    if (e < 0)
+    {
+        return e;
+    }
+
+    eeprom_stats_add(&dev->stats->writes, 1);
+    eeprom_stats_add(&dev->stats->bytes_written, size);
+    eeprom_stats_latency(dev->stats->write_latency, eeprom_stats_now() - start);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_read(eeprom_dev_t *dev, uint32_t offset, int size, char * buf)
+{
+    //scrub user input
+    int e = check_input_errors(dev, offset, size, buf);
+    if (e < 0)
+    {
+        return e;
+    }
+    const uint64_t start = eeprom_stats_now();
+    char err[1024];   //string holding fault handler error
+
+    //calculate effective address from base, check boundaries
+    const uint32_t device_size_words = dev->properties.device_size_words;
+    const uint32_t base_addr         = dev->properties.base_address;
+    const uint32_t effective_addr    = base_addr + offset;
+    if ((effective_addr < base_addr) || (effective_addr > device_size_words-1) ||
+        (size < 0) || (size > device_size_words - effective_addr))
+    {
+        snprintf(err, sizeof(err),
+            "Bad offset address, bounds are [%i, %i]", base_addr, device_size_words-1);
+        dev->fault_handler(err);
+        return -EFAULT;
+    }
+
+    if (dev->cache != NULL)
+    {
+        int res = cache_read(dev, effective_addr, buf, size);
+        if (res < 0)
+        {
+            snprintf(err, sizeof(err), "Failed read of %i bytes", size);
+            dev->fault_handler(err);
+            return res;
+        }
+    }
+    else
+    {
+        //lock reentrant code protecting shared resource
+        uint64_t acquired;
+        int      res = lock_range(dev, effective_addr, size, 0, &acquired);
+        if (res == 0)
+        {
+            //single sequential read, address sent once
+            res = device_read_range(dev, effective_addr, buf, size);
+            unlock_range(dev, effective_addr, size, acquired);
+        }
         if (res < 0)
         {
-            pthread_mutex_unlock((pthread_mutex_t*)(dev->mutex));
-            snprintf(err, sizeof(err), "Failed read on byte %i", byte_counter);
+            snprintf(err, sizeof(err), "Failed read of %i bytes", size);
             dev->fault_handler(err);
+            return res;
+        }
+    }
+
+    eeprom_stats_add(&dev->stats->reads, 1);
+    eeprom_stats_add(&dev->stats->bytes_read, size);
+    eeprom_stats_latency(dev->stats->read_latency, eeprom_stats_now() - start);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_writev(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt)
+{
+    //scrub user input
+    int e = check_input_errors(dev, 0, 0, NULL);
+    if (e < 0)
+    {
+        return e;
+    }
+    if ((iov == NULL) || (iovcnt <= 0))
+    {
+        return (iovcnt == 0) ? 0 : -EINVAL;
+    }
+    const uint64_t start = eeprom_stats_now();
+    uint32_t       bytes = 0;
+    int            i;
+    for (i = 0; i < iovcnt; i++)
+    {
+        bytes += (iov[i].len > 0) ? iov[i].len : 0;
+    }
+    e = write_segments(dev, iov, iovcnt);
+    if (e < 0)
+    {
+        return e;
+    }
+
+    eeprom_stats_add(&dev->stats->writes, 1);
+    eeprom_stats_add(&dev->stats->bytes_written, bytes);
+    eeprom_stats_latency(dev->stats->write_latency, eeprom_stats_now() - start);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_readv(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt)
+{
+    //scrub user input
+    int e = check_input_errors(dev, 0, 0, NULL);
+    if (e < 0)
+    {
+        return e;
+    }
+    if ((iov == NULL) || (iovcnt <= 0))
+    {
+        return (iovcnt == 0) ? 0 : -EINVAL;
+    }
+    const uint64_t start = eeprom_stats_now();
+    char           err[1024];
+    eeprom_span_t *spans;
+    uint32_t       staged;
+    int            n = build_spans(dev, iov, iovcnt, &spans, &staged, NULL, NULL);
+    if (n <= 0)
+    {
+        return n;
+    }
+    const uint32_t lo = spans[0].addr;
+    const uint32_t hi = spans[n-1].addr + spans[n-1].len;
+    if (dev->cache != NULL)
+    {
+        //one lock free copy of the whole extent keeps spans consistent
+        n              = 1;
+        spans[0].len   = hi - lo;
+        spans[0].stage = 0;
+        staged         = hi - lo;
+    }
+    char *stage = malloc(staged);
+    if (stage == NULL)
+    {
+        free(spans);
+        return -ENOMEM;
+    }
+
+    int i      = 1;
+    int result = 0;
+    if (dev->cache != NULL)
+    {
+        result = cache_read(dev, lo, stage, staged);
+    }
+    else
+    {
+        //one sequential read per span under a single lock
+        uint64_t acquired;
+        result = lock_range(dev, lo, hi - lo, 0, &acquired);
+        if (result == 0)
+        {
+            for (i = 0; (i < n) && (result == 0); i++)
+            {
+                result = device_read_range(dev, spans[i].addr,
+                    stage + spans[i].stage, spans[i].len);
+            }
+            unlock_range(dev, lo, hi - lo, acquired);
+        }
+    }
+    if (result < 0)
+    {
+        snprintf(err, sizeof(err), "Failed vector read at address %i", spans[i-1].addr);
+        free(stage);
+        free(spans);
+        dev->fault_handler(err);
+        return result;
+    }
+
+    //scatter to caller segments
+    uint32_t bytes = 0;
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].len == 0)
+        {
+            continue;
+        }
+        const uint32_t       addr = dev->properties.base_address + iov[i].offset;
+        const eeprom_span_t *span = find_span(spans, n, addr);
+        memcpy(iov[i].buf, stage + span->stage + (addr - span->addr), iov[i].len);
+        bytes += iov[i].len;
+    }
+    free(stage);
+    free(spans);
+
+    eeprom_stats_add(&dev->stats->reads, 1);
+    eeprom_stats_add(&dev->stats->bytes_read, bytes);
+    eeprom_stats_latency(dev->stats->read_latency, eeprom_stats_now() - start);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_verify(eeprom_dev_t *dev, uint32_t offset, int size)
+{
+    //scrub user input
+    int e = check_input_errors(dev, offset, size, NULL);
+    if (e < 0)
+    {
+        return e;
+    }
+    char err[1024];   //string holding fault handler error
+
+    //calculate effective address from base, check boundaries
+    const uint32_t device_size_words = dev->properties.device_size_words;
+    const uint32_t base_addr         = dev->properties.base_address;
+    const uint32_t effective_addr    = base_addr + offset;
+    if ((effective_addr < base_addr) || (effective_addr > device_size_words-1) ||
+        (size < 0) || (size > device_size_words - effective_addr))
+    {
+        snprintf(err, sizeof(err),
+            "Bad offset address, bounds are [%i, %i]", base_addr, device_size_words-1);
+        dev->fault_handler(err);
+        return -EFAULT;
+    }
+    if (size == 0)
+    {
+        return 0; //no pages
+    }
+
+    //whole pages, the image may end in a short one
+    const eeprom_geom_t *geom = &dev->geom;
+    const uint32_t       page = geom->page;
+    const uint32_t       lo   = effective_addr - eeprom_geom_offset(geom, effective_addr);
+    uint32_t             hi   = eeprom_geom_start(geom,
+        eeprom_geom_page(geom, effective_addr + size + page - 1));
+    if (hi > (uint32_t)eeprom_device_size(dev->hw))
+    {
+        hi = eeprom_device_size(dev->hw);
+    }
+    char *buf = malloc(hi - lo);
+    if (buf == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    //checksums only change under the write lock, so they agree
+    //with what the read returns
+    uint64_t acquired;
+    e = lock_range(dev, lo, hi - lo, 0, &acquired);
+    if (e < 0)
+    {
+        free(buf);
+        return e;
+    }
+    e = device_read_range(dev, lo, buf, hi - lo);
+    int      bad = 0;
+    uint32_t addr;
+    for (addr = lo; (addr < hi) && (e == 0); addr += page)
+    {
+        const uint32_t n = (hi - addr < page) ? hi - addr : page;
+        uint32_t       expect;
+        e = eeprom_device_page_crc(dev->hw, eeprom_geom_page(geom, addr), &expect);
+        if ((e == 0) && (crc32c(0, buf + (addr - lo), n) != expect))
+        {
+            bad++;
+        }
+    }
+    unlock_range(dev, lo, hi - lo, acquired);
+    free(buf);
+
+    if (e < 0)
+    {
+        snprintf(err, sizeof(err), "Failed verify of %i bytes", size);
+        dev->fault_handler(err);
+        return e;
+    }
+    return bad;
+}
+
+//Public specification in header
+int eeprom_map_ro(eeprom_dev_t *dev, uint32_t offset, int size, eeprom_map_t *map)
+{
+    //scrub user input
+    int e = check_input_errors(dev, offset, size, NULL);
+    if (e < 0)
+    {
+        return e;
+    }
+    if ((map == NULL) || (size <= 0))
+    {
+        return -EINVAL;
+    }
+    char err[1024];   //string holding fault handler error
+
+    //calculate effective address from base, check boundaries
+    const uint32_t device_size_words = dev->properties.device_size_words;
+    const uint32_t base_addr         = dev->properties.base_address;
+    const uint32_t effective_addr    = base_addr + offset;
+    if ((effective_addr < base_addr) || (effective_addr > device_size_words-1) ||
+        (size > device_size_words - effective_addr))
+    {
+        snprintf(err, sizeof(err),
+            "Bad offset address, bounds are [%i, %i]", base_addr, device_size_words-1);
+        dev->fault_handler(err);
+        return -EFAULT;
+    }
+
+    //shadow holds the newest contents when there is one
+    if (dev->cache != NULL)
+    {
+        map->data = dev->cache->image + effective_addr;
+    }
+    else
+    {
+        e = eeprom_device_map_ro(dev->hw, effective_addr, size, &map->data);
+        if (e < 0)
+        {
+            map->data = NULL;
+            return e;
+        }
+    }
+    map->addr = effective_addr;
+    map->size = size;
+
+    //start from a generation with no write in flight; the writer
+    //holds the range for one copy or page store, longer only if
+    //it stalled or died, and then the lock waits or repairs
+    int spins = 0;
+    while (map_generation(dev, map, &map->gen))
+    {
+        if (++spins < MAP_SPIN_LIMIT)
+        {
+            continue;
+        }
+        uint64_t acquired;
+        e = lock_range(dev, effective_addr, size, 0, &acquired);
+        if (e < 0)
+        {
+            map->data = NULL;
+            return e;
         }
+        int busy = map_generation(dev, map, &map->gen);
+        unlock_range(dev, effective_addr, size, acquired);
+        if (busy)
+        {
+            map->data = NULL;
+            return -EAGAIN;
+        }
+        break;
+    }
+    __atomic_fetch_add(&dev->maps, 1, __ATOMIC_ACQ_REL);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_map_changed(eeprom_dev_t *dev, const eeprom_map_t *map)
+{
+    if (dev == NULL)
+    {
+        return -ENODEV;
+    }
+    if ((map == NULL) || (map->data == NULL))
+    {
+        return -EINVAL;
     }
-    pthread_mutex_unlock((pthread_mutex_t*)(dev->mutex));
+    uint64_t gen;
+    //bytes consumed before generation is read again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    int busy = map_generation(dev, map, &gen);
+    return busy || (gen != map->gen);
+}
 
+//Public specification in header
+int eeprom_unmap(eeprom_dev_t *dev, eeprom_map_t *map)
+{
+    if (dev == NULL)
+    {
+        return -ENODEV;
+    }
+    if ((map == NULL) || (map->data == NULL))
+    {
+        return -EINVAL;
+    }
+    map->data = NULL;
+    __atomic_fetch_sub(&dev->maps, 1, __ATOMIC_ACQ_REL);
     return 0; //success
 }
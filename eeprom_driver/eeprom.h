@@ -14,23 +14,92 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#include "device/eeprom_device.h"
+#include "eeprom_cache.h"
+#include "eeprom_geom.h"
+#include "eeprom_lock.h"
+#include "eeprom_shm.h"
+#include "eeprom_stats.h"
+
+//eeprom_dev_t flags
+#define EEPROM_F_CACHE   (1 << 0) //write-back page cache, see eeprom_flush
+#define EEPROM_F_JOURNAL (1 << 1) //atomic multi-page writes, see eeprom_write
+#define EEPROM_F_ELIDE   (1 << 2) //skip unchanged pages, see eeprom_write
+#define EEPROM_F_CRC     (1 << 3) //per-page checksums, see eeprom_verify
+
+//Scatter-gather segment for eeprom_readv/eeprom_writev
+typedef struct eeprom_iovec
+{
+    //base relative location
+    uint32_t offset;
+
+    //number of bytes
+    int len;
+
+    //data buffer
+    char *buf;
+
+} eeprom_iovec_t;
+
+//Per transaction retry policy, see eeprom_dev_t retry
+typedef struct eeprom_retry
+{
+    //tries per page write or sequential read, zero or one for
+    //a single try
+    uint32_t attempts;
+
+    //wait before the second try, doubled before each later one
+    uint32_t backoff_us;
+
+    //no try starts later than this after the first, zero for
+    //no limit
+    uint32_t deadline_us;
+
+} eeprom_retry_t;
+
+//Read-only view returned by eeprom_map_ro
+typedef struct eeprom_map
+{
+    //first mapped byte, valid until eeprom_unmap
+    const char *data;
+
+    //effective device address and number of bytes
+    uint32_t addr;
+    int      size;
+
+    //generation of the range when mapped, see eeprom_map_changed
+    uint64_t gen;
+
+} eeprom_map_t;
+
 //Model-specific hardware device struct
 typedef struct eeprom_dev_properties
 {
     // Base Address
-    uint8_t base_address;
+    uint32_t base_address;
 
     // Total Memory Size in Bits (64 Kb)
     uint32_t device_size_bits;
 
     // Total Memory Size in 8-bit Words (ie. length of file)
-    uint16_t device_size_words;
+    uint32_t device_size_words;
 
     // Word Size
     uint8_t word_size_bits;
 
     // Page Size in Bytes
-    uint8_t page_size_bytes;
+    uint16_t page_size_bytes;
+
+    // Words per Bank: chips stacked behind chip-select bits, each
+    // running its own write cycle. Multiple of the page size, 0
+    // for a single chip
+    uint32_t bank_size_words;
+
+    // Words per Block: blocks of one chip picked by block-select
+    // bits in the control byte. Addressing only, the blocks share
+    // the chip's write cycle. Multiple of the page size and
+    // dividing any bank size, 0 for none
+    uint32_t block_size_words;
 
 } eeprom_dev_properties_t;
 
@@ -38,9 +107,17 @@ typedef struct eeprom_dev_properties
 //Device struct per driver
 typedef struct eeprom_dev
 {
-    //device mutex
+    //device mutex, unused with shm_name
     pthread_mutex_t *mutex;
 
+    //optional striped reader/writer page lock used instead of
+    //mutex when set, see eeprom_lock.h; unused with shm_name
+    eeprom_lock_t *lock;
+
+    //optional write-coalescing scheduler shared like the mutex,
+    //see eeprom_sched.h; ignored with EEPROM_F_CACHE
+    struct eeprom_sched *sched;
+
     //properties struct
     eeprom_dev_properties_t properties;
 
@@ -51,16 +128,166 @@ typedef struct eeprom_dev
     //device id - used mostly for debugging purposes
     int id;
 
+    //hardware tier backing image file, NULL for DEVICE_FILE_NAME.
+    //Device structs naming the same file share one open image.
+    const char *image_path;
+
+    //hardware tier backend selected on open: positioned file i/o
+    //(EEPROM_DEVICE_PIO, the zero default), mmap, pure RAM or the
+    //timing simulated bus, see eeprom_device_backend_t
+    eeprom_device_backend_t backend;
+
+    //EEPROM_F_* option bits, zero for defaults
+    uint32_t flags;
+
+    //EEPROM_F_CACHE: period of background flush in ms, zero to
+    //flush only on eeprom_flush and eeprom_close
+    uint32_t cache_flush_ms;
+
+    //simulated I2C bus timing applied to the image on open, zero
+    //clock_hz leaves transactions untimed
+    eeprom_device_timing_t timing;
+
+    //transactions failing with a transient error (anything but a
+    //bad address or argument) are tried again under this policy
+    //before the failure is reported; zero for a single try
+    eeprom_retry_t retry;
+
+    //optional shared memory segment name, leading '/'. Device
+    //structs in any process naming the same segment share one
+    //device mutex, one set of counters and, with EEPROM_F_CACHE,
+    //one shadow, see eeprom_shm.h. The segment mutex is used in
+    //place of mutex and lock, which are ignored. EEPROM_F_CRC and
+    //EEPROM_F_JOURNAL keep per process state and are refused.
+    const char *shm_name;
+
+    //driver owned state, set up by eeprom_open
+    eeprom_device_t *hw;
+    eeprom_cache_t  *cache;
+
+    //driver owned submission queue, see eeprom_async.h
+    struct eeprom_async *async;
+
+    //driver owned runtime counters, read with eeprom_get_stats
+    eeprom_stats_t *stats;
+
+    //driver owned mapping of shm_name, NULL without one
+    eeprom_shm_t *shm;
+
+    //driver owned count of mappings not yet passed to eeprom_unmap
+    int maps;
+
+    //driver owned page arithmetic for properties.page_size_bytes
+    eeprom_geom_t geom;
+
 } eeprom_dev_t;
 
 
+//----------------------------------------------------------
+// eeprom_open
+//
+// Open EEPROM Device:
+// Brings up the hardware tier for dev's image_path and checks
+// that the device image is large enough for dev's properties. With
+// EEPROM_F_CACHE set in dev->flags the whole device is read
+// into a RAM shadow that serves reads and absorbs writes; only
+// one such device struct may have an image open at a time, or
+// else -EBUSY, unless all are views of one shm_name. A
+// nonzero dev->timing.clock_hz turns on the bus timing model
+// for the image (eeprom_device_set_timing); transactions then
+// ACK-poll while the part is in its write cycle.
+// EEPROM_F_CRC starts per-page checksum tracking on the image.
+// A nonzero properties.bank_size_words splits the device into
+// banks (eeprom_device_set_banks): transfers are split at bank
+// boundaries and writes spanning banks interleave their pages so
+// one bank's write cycle overlaps the next bank's transfer. A
+// nonzero properties.block_size_words only splits transfers at
+// block boundaries.
+// With dev->shm_name set the driver state is attached from (or
+// created in) that shared memory segment instead of allocated;
+// EEPROM_F_CRC or EEPROM_F_JOURNAL with it is -EINVAL.
+// Must be called before any transaction on dev.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[out] : int    - 0 on success, -EBUSY if the image is
+//                        already shadowed by another device struct
+//
+int eeprom_open(eeprom_dev_t *dev);
+
+
+//----------------------------------------------------------
+// eeprom_flush
+//
+// Flush EEPROM Device:
+// With EEPROM_F_CACHE, programs every dirty page of dev's
+// shadow back to the device, one page write per page. Other
+// device structs sharing the image only observe cached writes
+// once flushed. No-op without a cache.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[out] : int    - 0 on success
+//
+int eeprom_flush(eeprom_dev_t *dev);
+
+
+//----------------------------------------------------------
+// eeprom_sync
+//
+// Sync EEPROM Device:
+// eeprom_flush, then waits until every page written so far is
+// durable in the image file (eeprom_device_sync).
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[out] : int    - 0 on success
+//
+int eeprom_sync(eeprom_dev_t *dev);
+
+
+//----------------------------------------------------------
+// eeprom_close
+//
+// Close EEPROM Device:
+// Drains any asynchronous queue, flushes and frees any cache,
+// then releases the hardware tier reference taken by
+// eeprom_open. Fails without closing while mappings from
+// eeprom_map_ro are outstanding.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[out] : int    - 0 on success, -EBUSY while mapped
+//
+int eeprom_close(eeprom_dev_t *dev);
+
+
+//----------------------------------------------------------
+// eeprom_get_stats
+//
+// Get Device Statistics:
+// Copies dev's runtime counters into stats. Counters are kept
+// without locks and may be read while transactions run.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : stats  - snapshot destination
+// @param[out] : int    - 0 on success
+//
+int eeprom_get_stats(eeprom_dev_t *dev, eeprom_stats_t *stats);
+
+
 //----------------------------------------------------------
 // eeprom_write
 //
 // Write to EEPROM Device:
 // Performs device-independent page calculations and initiates
-// page write transaction. Emulates i2c bus communication but
-// instead of separating address and data, sends both at once.
+// one page write transaction per page touched. Emulates i2c bus
+// communication but instead of separating address and data,
+// sends both at once. With EEPROM_F_JOURNAL a write spanning
+// pages is journaled first, so after a crash the next open sees
+// either none or all of it, and a write that fails is rolled
+// back before returning. Cached writes are not journaled.
+// With EEPROM_F_ELIDE the range is compared with the current
+// contents first: unchanged pages are not programmed and changed
+// pages are programmed from their first to last changed byte.
+// With dev->sched set the write is queued and committed together
+// with writes queued concurrently by other threads.
 //----------------------------------------------------------
 // @param[in]  : dev    - process independent device struct
 // @param[in]  : offset - base relative write location
@@ -71,12 +298,40 @@ typedef struct eeprom_dev
 int eeprom_write(eeprom_dev_t *dev, uint32_t offset, int size, char * buf);
 
 
+//----------------------------------------------------------
+// eeprom_write_partial
+//
+// Write to EEPROM Device Reporting Progress:
+// As eeprom_write, but a transaction that still fails after
+// dev->retry is returned rather than passed to the fault
+// handler, with the number of leading bytes already committed
+// to the device. Pages are programmed in address order, so
+// [offset, offset+*committed) holds buf's data. Not coalesced
+// through dev->sched. Without EEPROM_F_JOURNAL the rest of the
+// range is left as it was; with it a write spanning pages is
+// rolled back and *committed is 0, unless the roll back fails
+// and it is completed instead, which returns 0.
+//----------------------------------------------------------
+// @param[in]  : dev       - process independent device struct
+// @param[in]  : offset    - base relative write location
+// @param[in]  : size      - number of bytes to write
+// @param[in]  : buf       - user specified data buffer
+// @param[in]  : committed - receives bytes committed
+// @param[out] : int       - 0 on success, negative error otherwise
+//
+int eeprom_write_partial(eeprom_dev_t *dev, uint32_t offset, int size,
+    const char *buf, int *committed);
+
+
 //----------------------------------------------------------
 // eeprom_read
 //
 // Read from EEPROM Device
-// Reads single stride byte aligned data from device and stores
-// in user specified buffer.
+// Reads byte aligned data from device in a single sequential
+// read transaction and stores in user specified buffer. With
+// EEPROM_F_CACHE the data is copied from the shadow without
+// taking the device lock; the copy is retried if it races a
+// write, so it never observes half of one eeprom_write.
 //----------------------------------------------------------
 // @param[in]  : dev    - process independent device struct
 // @param[in]  : offset - base relative read location
@@ -87,4 +342,115 @@ int eeprom_write(eeprom_dev_t *dev, uint32_t offset, int size, char * buf);
 int eeprom_read(eeprom_dev_t *dev, uint32_t offset, int size, char * buf);
 
 
+//----------------------------------------------------------
+// eeprom_writev
+//
+// Scatter-Gather Write to EEPROM Device:
+// Writes every segment of iov under one lock acquisition.
+// Segments are sorted by address and merged where they overlap,
+// touch, or share a page, then each merged span is written with
+// one page write per page, so no page is programmed twice.
+// In-page gaps between segments are filled with the current
+// contents. Where segments overlap, the later one in iov wins.
+// With EEPROM_F_JOURNAL all spans are journaled as one record.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : iov    - segments to write
+// @param[in]  : iovcnt - number of segments
+// @param[out] : int    - 0 on success
+//
+int eeprom_writev(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt);
+
+
+//----------------------------------------------------------
+// eeprom_readv
+//
+// Scatter-Gather Read from EEPROM Device:
+// Fills every segment of iov under one lock acquisition, with
+// one sequential read per merged span (see eeprom_writev). With
+// EEPROM_F_CACHE all segments come from one lock free copy.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : iov    - segments to fill
+// @param[in]  : iovcnt - number of segments
+// @param[out] : int    - 0 on success
+//
+int eeprom_readv(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt);
+
+
+//----------------------------------------------------------
+// eeprom_verify
+//
+// Verify EEPROM Device Contents:
+// Requires EEPROM_F_CRC. Reads every page overlapping the range
+// with one sequential read and compares its crc32c with the
+// checksum kept by the hardware tier since the page was last
+// programmed, so a write is checked without keeping or comparing
+// against a copy of its data. Over the whole device right after
+// eeprom_open this is a boot-time check against the checksums
+// saved at the last clean close. Cached writes are only checked
+// once flushed.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : offset - base relative start of range
+// @param[in]  : size   - number of bytes in range
+// @param[out] : int    - number of pages that do not match,
+//                        negative on error
+//
+int eeprom_verify(eeprom_dev_t *dev, uint32_t offset, int size);
+
+
+//----------------------------------------------------------
+// eeprom_map_ro
+//
+// Map EEPROM Device Range Read-Only:
+// Points map->data at size bytes from offset inside the
+// EEPROM_F_CACHE shadow, or else inside the contents of an
+// EEPROM_DEVICE_RAM device or the mapping of an EEPROM_DEVICE_MMAP
+// binary image, so large read-mostly data is
+// consumed in place without a copy or any lock. Writes may still
+// change the bytes underneath; map->gen records the range's
+// generation once no write to it is in progress, and
+// eeprom_map_changed tells whether data read since is torn.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : offset - base relative start of range
+// @param[in]  : size   - number of bytes
+// @param[in]  : map    - receives view of the range
+// @param[out] : int    - 0 on success, -ENOTSUP when contents
+//                        are not held in memory
+//
+int eeprom_map_ro(eeprom_dev_t *dev, uint32_t offset, int size, eeprom_map_t *map);
+
+
+//----------------------------------------------------------
+// eeprom_map_changed
+//
+// Check EEPROM Mapping:
+// Tells whether a write to the mapped range started or finished
+// since eeprom_map_ro. Call after consuming map->data; if it
+// returns nonzero, unmap and map again to get a consistent view.
+// Without a cache every write to the image counts.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : map    - view from eeprom_map_ro
+// @param[out] : int    - nonzero if the range may have changed
+//
+int eeprom_map_changed(eeprom_dev_t *dev, const eeprom_map_t *map);
+
+
+//----------------------------------------------------------
+// eeprom_unmap
+//
+// Unmap EEPROM Device Range:
+// Releases a view taken by eeprom_map_ro; map->data must not be
+// used afterwards.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : map    - view from eeprom_map_ro
+// @param[out] : int    - 0 on success
+//
+int eeprom_unmap(eeprom_dev_t *dev, eeprom_map_t *map);
+
+
 #endif
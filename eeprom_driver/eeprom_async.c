@@ -0,0 +1,257 @@
+/* eeprom_async.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_async.h"
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+//----------------------------------------------------------
+// async_worker
+//
+// Worker thread body. Runs queued requests in submission order
+// and posts their results until stopped with an empty ring.
+//----------------------------------------------------------
+// @param[in]  : arg - process independent device struct
+//
+static void *async_worker(void *arg)
+{
+    eeprom_dev_t   *dev   = arg;
+    eeprom_async_t *async = dev->async;
+
+    pthread_mutex_lock(&async->lock);
+    for (;;)
+    {
+        while ((async->sq_count == 0) && !async->stopping)
+        {
+            pthread_cond_wait(&async->submitted, &async->lock);
+        }
+        if (async->sq_count == 0) //stopping and drained
+        {
+            break;
+        }
+        eeprom_request_t req = async->sq[async->sq_head];
+        async->sq_head = (async->sq_head + 1) % async->depth;
+        async->sq_count--;
+        pthread_mutex_unlock(&async->lock);
+
+        int result = req.write ?
+            eeprom_write(dev, req.offset, req.size, req.buf) :
+            eeprom_read(dev, req.offset, req.size, req.buf);
+
+        if (req.cb != NULL)
+        {
+            req.cb(req.ctx, result);
+            pthread_mutex_lock(&async->lock);
+            async->outstanding--;
+            continue;
+        }
+
+        pthread_mutex_lock(&async->lock);
+        uint32_t tail = (async->cq_head + async->cq_count) % async->depth;
+        async->cq[tail].ctx    = req.ctx;
+        async->cq[tail].result = result;
+        async->cq_count++;
+        uint64_t one = 1;
+        if (write(async->event_fd, &one, sizeof(one)) < 0)
+        {
+            //counter saturated, fd is already readable
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+//----------------------------------------------------------
+// async_submit
+//
+// Common half of eeprom_submit_read/eeprom_submit_write.
+//----------------------------------------------------------
+// @param[in]  : dev - process independent device struct
+// @param[in]  : req - request to queue
+// @param[out] : int - 0 on success
+//
+static int async_submit(eeprom_dev_t *dev, const eeprom_request_t *req)
+{
+    if (dev == NULL)
+    {
+        return -ENODEV;
+    }
+    eeprom_async_t *async = dev->async;
+    if (async == NULL)
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&async->lock);
+    if (async->stopping || (async->outstanding == async->depth))
+    {
+        pthread_mutex_unlock(&async->lock);
+        return -EAGAIN;
+    }
+    uint32_t tail = (async->sq_head + async->sq_count) % async->depth;
+    async->sq[tail] = *req;
+    async->sq_count++;
+    async->outstanding++;
+    pthread_cond_signal(&async->submitted);
+    pthread_mutex_unlock(&async->lock);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_async_start(eeprom_dev_t *dev, uint32_t depth)
+{
+    if (dev == NULL)
+    {
+        return -ENODEV;
+    }
+    if (depth == 0)
+    {
+        return -EINVAL;
+    }
+    if (dev->async != NULL)
+    {
+        return -EBUSY;
+    }
+
+    eeprom_async_t *async = calloc(1, sizeof(eeprom_async_t));
+    if (async == NULL)
+    {
+        return -ENOMEM;
+    }
+    async->depth    = depth;
+    async->sq       = calloc(depth, sizeof(eeprom_request_t));
+    async->cq       = calloc(depth, sizeof(eeprom_completion_t));
+    async->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((async->sq == NULL) || (async->cq == NULL) || (async->event_fd < 0))
+    {
+        if (async->event_fd >= 0)
+        {
+            close(async->event_fd);
+        }
+        free(async->sq);
+        free(async->cq);
+        free(async);
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->submitted, NULL);
+
+    dev->async = async;
+    if (pthread_create(&async->worker, NULL, async_worker, dev) != 0)
+    {
+        dev->async = NULL;
+        pthread_cond_destroy(&async->submitted);
+        pthread_mutex_destroy(&async->lock);
+        close(async->event_fd);
+        free(async->sq);
+        free(async->cq);
+        free(async);
+        return -EAGAIN;
+    }
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_async_stop(eeprom_dev_t *dev)
+{
+    if (dev == NULL)
+    {
+        return -ENODEV;
+    }
+    eeprom_async_t *async = dev->async;
+    if (async == NULL)
+    {
+        return 0; //never started
+    }
+
+    pthread_mutex_lock(&async->lock);
+    async->stopping = 1;
+    pthread_cond_signal(&async->submitted);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->worker, NULL);
+
+    dev->async = NULL;
+    pthread_cond_destroy(&async->submitted);
+    pthread_mutex_destroy(&async->lock);
+    close(async->event_fd);
+    free(async->sq);
+    free(async->cq);
+    free(async);
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_submit_write(eeprom_dev_t *dev, uint32_t offset, int size, char *buf,
+    eeprom_complete_t cb, void *ctx)
+{
+    eeprom_request_t req = {
+        .write  = 1,
+        .offset = offset,
+        .size   = size,
+        .buf    = buf,
+        .cb     = cb,
+        .ctx    = ctx,
+    };
+    return async_submit(dev, &req);
+}
+
+//Public specification in header
+int eeprom_submit_read(eeprom_dev_t *dev, uint32_t offset, int size, char *buf,
+    eeprom_complete_t cb, void *ctx)
+{
+    eeprom_request_t req = {
+        .write  = 0,
+        .offset = offset,
+        .size   = size,
+        .buf    = buf,
+        .cb     = cb,
+        .ctx    = ctx,
+    };
+    return async_submit(dev, &req);
+}
+
+//Public specification in header
+int eeprom_completion_fd(eeprom_dev_t *dev)
+{
+    if ((dev == NULL) || (dev->async == NULL))
+    {
+        return -EINVAL;
+    }
+    return dev->async->event_fd;
+}
+
+//Public specification in header
+int eeprom_reap(eeprom_dev_t *dev, eeprom_completion_t *out, int max)
+{
+    if ((dev == NULL) || (dev->async == NULL) || (out == NULL))
+    {
+        return -EINVAL;
+    }
+    eeprom_async_t *async = dev->async;
+
+    pthread_mutex_lock(&async->lock);
+    int n = 0;
+    while ((n < max) && (async->cq_count > 0))
+    {
+        out[n++] = async->cq[async->cq_head];
+        async->cq_head = (async->cq_head + 1) % async->depth;
+        async->cq_count--;
+        async->outstanding--;
+    }
+    //reset eventfd, leave it readable if entries remain
+    uint64_t count;
+    if (read(async->event_fd, &count, sizeof(count)) > 0 && async->cq_count > 0)
+    {
+        count = async->cq_count;
+        if (write(async->event_fd, &count, sizeof(count)) < 0)
+        {
+            //counter saturated, fd is already readable
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+    return n;
+}
@@ -0,0 +1,159 @@
+/* eeprom_async.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_async_h
+#define _eeprom_async_h
+
+#include "eeprom.h"
+
+//Completion callback, runs on the driver's worker thread.
+//result is the eeprom_read/eeprom_write return value.
+typedef void (*eeprom_complete_t)(void *ctx, int result);
+
+//Completion queue entry for requests submitted without callback
+typedef struct eeprom_completion
+{
+    //ctx argument given at submission
+    void *ctx;
+
+    //eeprom_read/eeprom_write return value
+    int result;
+
+} eeprom_completion_t;
+
+//Request queued for the worker thread
+typedef struct eeprom_request
+{
+    int                write;
+    uint32_t           offset;
+    int                size;
+    char              *buf;
+    eeprom_complete_t  cb;
+    void              *ctx;
+
+} eeprom_request_t;
+
+//Submission/completion rings and worker owned by one device
+//struct, created by eeprom_async_start
+typedef struct eeprom_async
+{
+    pthread_t       worker;
+    pthread_mutex_t lock;
+    pthread_cond_t  submitted;
+    int             stopping;
+
+    //ring capacity, also bound on requests not yet reaped
+    uint32_t depth;
+    uint32_t outstanding;
+
+    //submission ring
+    eeprom_request_t *sq;
+    uint32_t          sq_head;
+    uint32_t          sq_count;
+
+    //completion ring, never overflows since outstanding <= depth
+    eeprom_completion_t *cq;
+    uint32_t             cq_head;
+    uint32_t             cq_count;
+
+    //eventfd readable while cq holds entries
+    int event_fd;
+
+} eeprom_async_t;
+
+
+//----------------------------------------------------------
+// eeprom_async_start
+//
+// Start Asynchronous Queue:
+// Creates dev's worker thread and submission/completion rings
+// of depth entries. dev must be open.
+//----------------------------------------------------------
+// @param[in]  : dev   - process independent device struct
+// @param[in]  : depth - max requests submitted but not reaped
+// @param[out] : int   - 0 on success
+//
+int eeprom_async_start(eeprom_dev_t *dev, uint32_t depth);
+
+
+//----------------------------------------------------------
+// eeprom_async_stop
+//
+// Stop Asynchronous Queue:
+// Lets the worker finish every submitted request, then frees
+// the queue. Unreaped completions are dropped. Called by
+// eeprom_close.
+//----------------------------------------------------------
+// @param[in]  : dev - process independent device struct
+// @param[out] : int - 0 on success
+//
+int eeprom_async_stop(eeprom_dev_t *dev);
+
+
+//----------------------------------------------------------
+// eeprom_submit_write
+//
+// Queue Write to EEPROM Device:
+// Returns as soon as the request is queued; eeprom_write runs
+// on the worker thread. buf must stay valid until completion.
+// With cb NULL the result is posted to the completion queue.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : offset - base relative write location
+// @param[in]  : size   - number of bytes to write
+// @param[in]  : buf    - user specified data buffer
+// @param[in]  : cb     - completion callback or NULL
+// @param[in]  : ctx    - passed to cb or returned by eeprom_reap
+// @param[out] : int    - 0 on success, -EAGAIN if queue is full
+//
+int eeprom_submit_write(eeprom_dev_t *dev, uint32_t offset, int size, char *buf,
+    eeprom_complete_t cb, void *ctx);
+
+
+//----------------------------------------------------------
+// eeprom_submit_read
+//
+// Queue Read from EEPROM Device:
+// Read counterpart of eeprom_submit_write.
+//----------------------------------------------------------
+// @param[in]  : dev    - process independent device struct
+// @param[in]  : offset - base relative read location
+// @param[in]  : size   - number of bytes to read
+// @param[in]  : buf    - read data buffer
+// @param[in]  : cb     - completion callback or NULL
+// @param[in]  : ctx    - passed to cb or returned by eeprom_reap
+// @param[out] : int    - 0 on success, -EAGAIN if queue is full
+//
+int eeprom_submit_read(eeprom_dev_t *dev, uint32_t offset, int size, char *buf,
+    eeprom_complete_t cb, void *ctx);
+
+
+//----------------------------------------------------------
+// eeprom_completion_fd
+//
+// Returns an eventfd that polls readable while completions are
+// waiting to be reaped, for use with poll/epoll.
+//----------------------------------------------------------
+// @param[in]  : dev - process independent device struct
+// @param[out] : int - file descriptor, negative on error
+//
+int eeprom_completion_fd(eeprom_dev_t *dev);
+
+
+//----------------------------------------------------------
+// eeprom_reap
+//
+// Pops up to max completions without blocking.
+//----------------------------------------------------------
+// @param[in]  : dev - process independent device struct
+// @param[in]  : out - completion array
+// @param[in]  : max - capacity of out
+// @param[out] : int - number of completions, negative on error
+//
+int eeprom_reap(eeprom_dev_t *dev, eeprom_completion_t *out, int max);
+
+
+#endif
@@ -0,0 +1,111 @@
+/* eeprom_batch.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_batch.h"
+
+#define BATCH_MIN_SEGMENTS 16
+#define BATCH_MIN_ARENA    256
+
+//Public specification in header
+int eeprom_batch_begin(eeprom_dev_t *dev, eeprom_batch_t **batch)
+{
+    if ((dev == NULL) || (dev->hw == NULL))
+    {
+        return -ENODEV;
+    }
+    if (batch == NULL)
+    {
+        return -EINVAL;
+    }
+    eeprom_batch_t *b = calloc(1, sizeof(eeprom_batch_t));
+    if (b == NULL)
+    {
+        return -ENOMEM;
+    }
+    b->dev = dev;
+    *batch = b;
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_batch_write(eeprom_batch_t *batch, uint32_t offset, int size, const char *buf)
+{
+    if ((batch == NULL) || (size < 0) || ((size > 0) && (buf == NULL)))
+    {
+        return -EINVAL;
+    }
+    if (size == 0)
+    {
+        return 0; //nothing to add
+    }
+
+    //grow geometrically, pointers into arena are fixed up at commit
+    if (batch->count == batch->capacity)
+    {
+        int cap = batch->capacity ? 2*batch->capacity : BATCH_MIN_SEGMENTS;
+        eeprom_iovec_t *iov = realloc(batch->iov, cap * sizeof(eeprom_iovec_t));
+        if (iov == NULL)
+        {
+            return -ENOMEM;
+        }
+        batch->iov      = iov;
+        batch->capacity = cap;
+    }
+    if (size > batch->size - batch->used)
+    {
+        uint32_t need = batch->used + size;
+        uint32_t grow = batch->size ? 2*batch->size : BATCH_MIN_ARENA;
+        char    *arena;
+        while (grow < need)
+        {
+            grow *= 2;
+        }
+        arena = realloc(batch->arena, grow);
+        if (arena == NULL)
+        {
+            return -ENOMEM;
+        }
+        batch->arena = arena;
+        batch->size  = grow;
+    }
+
+    memcpy(batch->arena + batch->used, buf, size);
+    batch->iov[batch->count].offset = offset;
+    batch->iov[batch->count].len    = size;
+    batch->iov[batch->count].buf    = (char*)(uintptr_t)batch->used;
+    batch->count++;
+    batch->used += size;
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_batch_commit(eeprom_batch_t *batch)
+{
+    if (batch == NULL)
+    {
+        return -EINVAL;
+    }
+    int i;
+    for (i = 0; i < batch->count; i++)
+    {
+        batch->iov[i].buf = batch->arena + (uintptr_t)batch->iov[i].buf;
+    }
+    int e = eeprom_writev(batch->dev, batch->iov, batch->count);
+    eeprom_batch_abort(batch);
+    return e;
+}
+
+//Public specification in header
+void eeprom_batch_abort(eeprom_batch_t *batch)
+{
+    if (batch == NULL)
+    {
+        return;
+    }
+    free(batch->iov);
+    free(batch->arena);
+    free(batch);
+}
@@ -0,0 +1,87 @@
+/* eeprom_batch.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_batch_h
+#define _eeprom_batch_h
+
+#include "eeprom.h"
+
+//Writes accumulated for one eeprom_batch_commit. Data is copied
+//into an arena as it is added, so callers may reuse buffers.
+typedef struct eeprom_batch
+{
+    eeprom_dev_t *dev;
+
+    //segments in order added, buf holds arena offset until commit
+    eeprom_iovec_t *iov;
+    int             count;
+    int             capacity;
+
+    //copied write data
+    char    *arena;
+    uint32_t used;
+    uint32_t size;
+
+} eeprom_batch_t;
+
+
+//----------------------------------------------------------
+// eeprom_batch_begin
+//
+// Begin Write Batch:
+// Allocates an empty batch for dev. Nothing is locked until
+// eeprom_batch_commit.
+//----------------------------------------------------------
+// @param[in]  : dev   - open process independent device struct
+// @param[in]  : batch - receives new batch
+// @param[out] : int   - 0 on success
+//
+int eeprom_batch_begin(eeprom_dev_t *dev, eeprom_batch_t **batch);
+
+
+//----------------------------------------------------------
+// eeprom_batch_write
+//
+// Add Write to Batch:
+// Copies size bytes of buf into batch for offset. Later writes
+// in one batch win where they overlap earlier ones.
+//----------------------------------------------------------
+// @param[in]  : batch  - open batch
+// @param[in]  : offset - base relative write location
+// @param[in]  : size   - number of bytes to write
+// @param[in]  : buf    - data, copied
+// @param[out] : int    - 0 on success
+//
+int eeprom_batch_write(eeprom_batch_t *batch, uint32_t offset, int size, const char *buf);
+
+
+//----------------------------------------------------------
+// eeprom_batch_commit
+//
+// Commit Write Batch:
+// Applies every write with one eeprom_writev: coalesced by
+// page, programmed in address order under one lock acquisition,
+// each page at most once. With EEPROM_F_JOURNAL the batch is
+// atomic. Frees batch whether or not the commit succeeds.
+//----------------------------------------------------------
+// @param[in]  : batch - open batch
+// @param[out] : int   - 0 on success
+//
+int eeprom_batch_commit(eeprom_batch_t *batch);
+
+
+//----------------------------------------------------------
+// eeprom_batch_abort
+//
+// Abort Write Batch:
+// Frees batch without writing anything.
+//----------------------------------------------------------
+// @param[in]  : batch - open batch
+//
+void eeprom_batch_abort(eeprom_batch_t *batch);
+
+
+#endif
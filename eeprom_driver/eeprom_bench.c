@@ -0,0 +1,406 @@
+/* eeprom_bench.c
+ *
+ * Justin S. Selig
+ * Application Tier
+ *
+ * Throughput and latency benchmark. Sweeps transfer size, page
+ * alignment, read/write mix and thread count, and prints one
+ * JSON object with a result per case on stdout.
+ *
+ * usage: eeprom_bench [-n ops] [-t max_threads] [-b pio|mmap|ram|timed] [-c] [-e] [-k clock_hz] [-w twr_us] [-p image]
+ */
+
+#include "eeprom.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+
+//Global device mutex shared by every benchmark thread
+pthread_mutex_t bench_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//Transfer sizes swept, in bytes; last entry is the full device
+static const int sizes[] = {1, 8, 32, 64, 256, 1024, 8192};
+
+//Read/write mixes swept, percentage of operations that write
+static const int write_pcts[] = {0, 50, 100};
+
+//Benchmark configuration from command line
+typedef struct bench_config
+{
+    int                     ops_per_thread;
+    int                     max_threads;
+    eeprom_device_backend_t backend;
+    uint32_t                flags;
+    eeprom_device_timing_t  timing;
+    const char             *image_path;
+
+} bench_config_t;
+
+//Single sweep point, shared by its worker threads
+typedef struct bench_case
+{
+    const bench_config_t *config;
+    int                   size;
+    int                   misalign;  //bytes past a page boundary
+    int                   write_pct;
+    uint64_t             *latency_ns; //threads*ops samples
+
+} bench_case_t;
+
+//Per worker thread argument
+typedef struct bench_thread
+{
+    bench_case_t  *bcase;
+    int            index;
+    int            result;
+    eeprom_stats_t stats;
+
+} bench_thread_t;
+
+//Device geometry used for every case, a 24C64 part
+static const eeprom_dev_properties_t bench_props = {
+    .base_address = 0,
+    .device_size_bits = 65536,
+    .device_size_words = 8192,
+    .word_size_bits = 8,
+    .page_size_bytes = 32,
+};
+
+//Benchmark fault handler: report and keep going
+void bench_fault_handler(char *err)
+{
+    fprintf(stderr, "FAULT: %s\n", err);
+}
+
+//----------------------------------------------------------
+// now_ns
+//
+// Monotonic clock in nanoseconds.
+//----------------------------------------------------------
+// @param[out] : uint64_t - current time
+//
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//----------------------------------------------------------
+// bench_dev_open
+//
+// Allocates and opens a device struct for a benchmark thread.
+//----------------------------------------------------------
+// @param[in]  : config - benchmark configuration
+// @param[out] : eeprom_dev_t* - open device, NULL on failure
+//
+static eeprom_dev_t *bench_dev_open(const bench_config_t *config)
+{
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        return NULL;
+    }
+    dev->mutex         = &bench_lock;
+    dev->properties    = bench_props;
+    dev->fault_handler = bench_fault_handler;
+    dev->image_path    = config->image_path;
+    dev->backend       = config->backend;
+    dev->flags         = config->flags;
+    dev->timing        = config->timing;
+    if (eeprom_open(dev) < 0)
+    {
+        free(dev);
+        return NULL;
+    }
+    return dev;
+}
+
+//----------------------------------------------------------
+// bench_worker
+//
+// Issues ops_per_thread transfers at random page offsets and
+// records the latency of each.
+//----------------------------------------------------------
+// @param[in]  : arg - bench_thread_t
+//
+static void *bench_worker(void *arg)
+{
+    bench_thread_t       *thread = arg;
+    bench_case_t         *bcase  = thread->bcase;
+    const bench_config_t *config = bcase->config;
+    const int             page   = bench_props.page_size_bytes;
+    const int             words  = bench_props.device_size_words;
+    unsigned int          seed   = 0x5eed + thread->index;
+    uint64_t             *lat    = bcase->latency_ns +
+                                   (size_t)thread->index * config->ops_per_thread;
+    char                  buf[8192];
+    int                   i;
+
+    eeprom_dev_t *dev = bench_dev_open(config);
+    if (dev == NULL)
+    {
+        thread->result = -ENODEV;
+        return NULL;
+    }
+    memset(buf, 0x42 + thread->index, sizeof(buf));
+
+    //pages where a transfer of this size and alignment still fits
+    const int num_starts = (words - bcase->size - bcase->misalign) / page + 1;
+    for (i = 0; i < config->ops_per_thread; i++)
+    {
+        uint32_t offset = (rand_r(&seed) % num_starts) * page + bcase->misalign;
+        int      write  = (rand_r(&seed) % 100) < bcase->write_pct;
+        uint64_t start  = now_ns();
+        int res = write ?
+            eeprom_write(dev, offset, bcase->size, buf) :
+            eeprom_read(dev, offset, bcase->size, buf);
+        lat[i] = now_ns() - start;
+        if (res < 0)
+        {
+            thread->result = res;
+            break;
+        }
+    }
+
+    eeprom_get_stats(dev, &thread->stats);
+    eeprom_close(dev);
+    free(dev);
+    return NULL;
+}
+
+//----------------------------------------------------------
+// cmp_u64
+//
+// qsort comparator for latency samples.
+//----------------------------------------------------------
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+//----------------------------------------------------------
+// percentile
+//
+// Nearest rank percentile of sorted samples.
+//----------------------------------------------------------
+// @param[in]  : sorted - ascending samples
+// @param[in]  : n      - number of samples
+// @param[in]  : p      - percentile in [0, 100]
+// @param[out] : uint64_t - sample at rank
+//
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p)
+{
+    size_t rank = (size_t)(p / 100.0 * n);
+    return sorted[(rank < n) ? rank : n-1];
+}
+
+//----------------------------------------------------------
+// run_case
+//
+// Runs one sweep point on num_threads threads and prints its
+// JSON result object.
+//----------------------------------------------------------
+// @param[in]  : bcase       - sweep point
+// @param[in]  : num_threads - worker thread count
+// @param[in]  : first       - nonzero for the first result
+// @param[out] : int         - 0 on success
+//
+static int run_case(bench_case_t *bcase, int num_threads, int first)
+{
+    const int      ops = bcase->config->ops_per_thread;
+    const size_t   n   = (size_t)num_threads * ops;
+    pthread_t      tids[MAX_THREADS];
+    bench_thread_t threads[MAX_THREADS];
+    int            i;
+
+    bcase->latency_ns = calloc(n, sizeof(uint64_t));
+    if (bcase->latency_ns == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    uint64_t start = now_ns();
+    for (i = 0; i < num_threads; i++)
+    {
+        threads[i].bcase  = bcase;
+        threads[i].index  = i;
+        threads[i].result = 0;
+        memset(&threads[i].stats, 0, sizeof(eeprom_stats_t));
+        pthread_create(&tids[i], NULL, bench_worker, &threads[i]);
+    }
+    for (i = 0; i < num_threads; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    uint64_t lock_wait_ns = 0;
+    uint64_t lock_hold_ns = 0;
+    uint64_t programs     = 0;
+    uint64_t elided       = 0;
+    uint64_t calls        = 0;
+    for (i = 0; i < num_threads; i++)
+    {
+        lock_wait_ns += threads[i].stats.lock_wait_ns;
+        lock_hold_ns += threads[i].stats.lock_hold_ns;
+        programs     += threads[i].stats.page_programs;
+        elided       += threads[i].stats.pages_elided;
+        calls        += threads[i].stats.device_calls;
+        if (threads[i].result < 0)
+        {
+            fprintf(stderr, "case size %i thread %i failed: %i\n",
+                bcase->size, i, threads[i].result);
+            free(bcase->latency_ns);
+            return threads[i].result;
+        }
+    }
+
+    qsort(bcase->latency_ns, n, sizeof(uint64_t), cmp_u64);
+    double secs = elapsed / 1e9;
+    printf("%s\n    {\"size\": %i, \"misalign\": %i, \"write_pct\": %i, "
+        "\"threads\": %i, \"ops\": %zu, \"ops_per_sec\": %.1f, "
+        "\"bytes_per_sec\": %.1f, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+        "\"p999_ns\": %llu, \"lock_wait_ns\": %llu, \"lock_hold_ns\": %llu, "
+        "\"page_programs\": %llu, \"pages_elided\": %llu, \"device_calls\": %llu}",
+        first ? "" : ",",
+        bcase->size, bcase->misalign, bcase->write_pct, num_threads, n,
+        n / secs, (double)n * bcase->size / secs,
+        (unsigned long long)percentile(bcase->latency_ns, n, 50.0),
+        (unsigned long long)percentile(bcase->latency_ns, n, 99.0),
+        (unsigned long long)percentile(bcase->latency_ns, n, 99.9),
+        (unsigned long long)lock_wait_ns, (unsigned long long)lock_hold_ns,
+        (unsigned long long)programs, (unsigned long long)elided,
+        (unsigned long long)calls);
+
+    free(bcase->latency_ns);
+    bcase->latency_ns = NULL;
+    return 0; //success
+}
+
+//-b names, indexed by eeprom_device_backend_t
+static const char *backend_names[] = { "pio", "mmap", "ram", "timed" };
+
+int main(int argc, char **argv)
+{
+    bench_config_t config = {
+        .ops_per_thread = 200,
+        .max_threads    = 4,
+        .backend        = EEPROM_DEVICE_PIO,
+        .flags          = 0,
+        .image_path     = NULL,
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:b:cek:w:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                config.ops_per_thread = atoi(optarg);
+                break;
+            case 't':
+                config.max_threads = atoi(optarg);
+                break;
+            case 'b':
+                for (config.backend = EEPROM_DEVICE_TIMED;
+                     (config.backend > EEPROM_DEVICE_PIO) &&
+                     strcmp(optarg, backend_names[config.backend]);
+                     config.backend--)
+                {
+                    //unknown names fall back to pio
+                }
+                break;
+            case 'c':
+                config.flags |= EEPROM_F_CACHE;
+                break;
+            case 'e':
+                config.flags |= EEPROM_F_ELIDE;
+                break;
+            case 'k':
+                config.timing.clock_hz = atoi(optarg);
+                break;
+            case 'w':
+                config.timing.write_cycle_us = atoi(optarg);
+                break;
+            case 'p':
+                config.image_path = optarg;
+                break;
+            default:
+                fprintf(stderr,
+                    "usage: %s [-n ops] [-t max_threads] [-b pio|mmap|ram|timed] [-c] [-e] [-k clock_hz] [-w twr_us] [-p image]\n",
+                    argv[0]);
+                return -1;
+        }
+    }
+    if ((config.ops_per_thread < 1) || (config.max_threads < 1) ||
+        (config.max_threads > MAX_THREADS))
+    {
+        fprintf(stderr, "bad arguments\n");
+        return -1;
+    }
+
+    //save device contents so the benchmark leaves the image as found
+    const int words = bench_props.device_size_words;
+    char     *saved = malloc(words);
+    eeprom_dev_t *dev = bench_dev_open(&config);
+    if ((saved == NULL) || (dev == NULL) || (eeprom_read(dev, 0, words, saved) < 0))
+    {
+        fprintf(stderr, "failed to open device\n");
+        return -1;
+    }
+
+    printf("{\n  \"image\": \"%s\", \"backend\": \"%s\", \"cache\": %s, \"elide\": %s, \"clock_hz\": %u, "
+        "\"write_cycle_us\": %u, \"page_size_bytes\": %i, \"device_size_words\": %i, \"ops_per_thread\": %i,\n  \"results\": [",
+        config.image_path ? config.image_path : DEVICE_FILE_NAME,
+        backend_names[config.backend],
+        (config.flags & EEPROM_F_CACHE) ? "true" : "false",
+        (config.flags & EEPROM_F_ELIDE) ? "true" : "false",
+        config.timing.clock_hz, config.timing.write_cycle_us,
+        bench_props.page_size_bytes, words, config.ops_per_thread);
+
+    const int page  = bench_props.page_size_bytes;
+    int       first = 1;
+    int       s, a, m, t;
+    for (s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+    {
+        for (a = 0; a < 2; a++)
+        {
+            //aligned, then starting mid-page
+            int misalign = a ? page/2 : 0;
+            if (sizes[s] + misalign > words)
+            {
+                continue;
+            }
+            for (m = 0; m < sizeof(write_pcts)/sizeof(write_pcts[0]); m++)
+            {
+                for (t = 1; t <= config.max_threads; t *= 2)
+                {
+                    bench_case_t bcase = {
+                        .config    = &config,
+                        .size      = sizes[s],
+                        .misalign  = misalign,
+                        .write_pct = write_pcts[m],
+                    };
+                    if (run_case(&bcase, t, first) < 0)
+                    {
+                        eeprom_write(dev, 0, words, saved);
+                        eeprom_close(dev);
+                        return -1;
+                    }
+                    first = 0;
+                }
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    eeprom_write(dev, 0, words, saved);
+    eeprom_close(dev);
+    free(dev);
+    free(saved);
+    return 0;
+}
@@ -0,0 +1,448 @@
+/* eeprom_cache.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_cache.h"
+#include "eeprom_diff.h"
+#include "eeprom_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+
+#define BITS_PER_WORD 64
+#define SPIN_LIMIT    65536 //busy copies before a read gives up
+
+//----------------------------------------------------------
+// mark_dirty
+//
+// Sets dirty bits for every page in [first, last].
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[in]  : first - first page touched
+// @param[in]  : last  - last page touched
+//
+static void mark_dirty(eeprom_cache_t *cache, uint32_t first, uint32_t last)
+{
+    uint32_t page;
+    for (page = first; page <= last; page++)
+    {
+        __atomic_fetch_or(&cache->dirty[page/BITS_PER_WORD],
+            (uint64_t)1 << (page % BITS_PER_WORD), __ATOMIC_RELAXED);
+    }
+}
+
+//----------------------------------------------------------
+// seq_sum
+//
+// Sums sequence counts of pages [first, last]. Counts only grow,
+// so an unchanged sum means no page was written in between.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[in]  : first - first page
+// @param[in]  : last  - last page
+// @param[in]  : busy  - set if any page is being written
+// @param[out] : uint64_t - sum of counts
+//
+static uint64_t seq_sum(eeprom_cache_t *cache, uint32_t first, uint32_t last, int *busy)
+{
+    uint64_t sum = 0;
+    uint32_t page;
+    *busy = 0;
+    for (page = first; page <= last; page++)
+    {
+        uint64_t seq = __atomic_load_n(&cache->seq[page], __ATOMIC_ACQUIRE);
+        *busy |= seq & 1;
+        sum   += seq;
+    }
+    return sum;
+}
+
+//----------------------------------------------------------
+// seq_write
+//
+// Moves the counts of pages [first, last] to odd before a write
+// and back to even after it.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[in]  : first - first page
+// @param[in]  : last  - last page
+// @param[in]  : end   - zero before the write, nonzero after
+//
+static void seq_write(eeprom_cache_t *cache, uint32_t first, uint32_t last, int end)
+{
+    uint32_t page;
+    if (end)
+    {
+        //data stores complete before counts become even
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+    for (page = first; page <= last; page++)
+    {
+        __atomic_fetch_add(&cache->seq[page], 1, __ATOMIC_RELAXED);
+    }
+    if (!end)
+    {
+        //counts are odd before any data store
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+}
+
+//----------------------------------------------------------
+// count_poll
+//
+// Records one unacknowledged transaction, see ack_polls.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+//
+static void count_poll(eeprom_cache_t *cache)
+{
+    if (cache->ack_polls != NULL)
+    {
+        __atomic_fetch_add(cache->ack_polls, 1, __ATOMIC_RELAXED);
+    }
+}
+
+//----------------------------------------------------------
+// read_polled
+//
+// Reads from the device, ACK-polling with the CPU yielded while
+// the part finishes a write cycle, for at most one tWR.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[in]  : addr  - effective device address
+// @param[in]  : buf   - destination buffer
+// @param[in]  : len   - number of bytes
+// @param[out] : int   - 0 on success, -ETIMEDOUT if never acknowledged
+//
+static int read_polled(eeprom_cache_t *cache, uint32_t addr, char *buf, uint32_t len)
+{
+    uint64_t since = 0;
+    int      e;
+    while ((e = eeprom_device_read_range(cache->hw, addr, buf, len)) == -EAGAIN)
+    {
+        const uint64_t now = eeprom_stats_now();
+        since = since ? since : now;
+        if (now - since > eeprom_device_write_cycle(cache->hw))
+        {
+            return -ETIMEDOUT;
+        }
+        count_poll(cache);
+        sched_yield();
+    }
+    return e;
+}
+
+//Public specification in header
+size_t eeprom_cache_storage(uint32_t size_words, uint32_t page_size_bytes)
+{
+    const uint32_t num_pages = (size_words + page_size_bytes - 1) / page_size_bytes;
+    return ((num_pages + BITS_PER_WORD - 1) / BITS_PER_WORD) * sizeof(uint64_t) +
+        (size_t)num_pages * sizeof(uint64_t) + size_words;
+}
+
+//Public specification in header
+eeprom_cache_t *eeprom_cache_create(eeprom_device_t *hw, uint32_t size_words,
+    uint32_t page_size_bytes, int elide, uint64_t *ack_polls)
+{
+    return eeprom_cache_attach(hw, size_words, page_size_bytes, elide, ack_polls,
+        NULL, 1);
+}
+
+//Public specification in header
+eeprom_cache_t *eeprom_cache_attach(eeprom_device_t *hw, uint32_t size_words,
+    uint32_t page_size_bytes, int elide, uint64_t *ack_polls, void *storage, int warm)
+{
+    if (size_words == 0)
+    {
+        return NULL;
+    }
+    eeprom_cache_t *cache = calloc(1, sizeof(eeprom_cache_t));
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    if (eeprom_geom_init(&cache->geom, page_size_bytes) < 0)
+    {
+        free(cache);
+        return NULL;
+    }
+    cache->hw         = hw;
+    cache->size_words = size_words;
+    cache->elide      = elide;
+    cache->ack_polls  = ack_polls;
+    cache->num_pages  = eeprom_geom_page(&cache->geom, size_words + page_size_bytes - 1);
+    if (storage == NULL)
+    {
+        storage = calloc(1, eeprom_cache_storage(size_words, page_size_bytes));
+        if (storage == NULL)
+        {
+            free(cache);
+            return NULL;
+        }
+        cache->owned = 1;
+        warm = 1;
+    }
+
+    //dirty bits, then sequence counts, then contents
+    cache->dirty = storage;
+    cache->seq   = cache->dirty + (cache->num_pages + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    cache->image = (char*)(cache->seq + cache->num_pages);
+    if (!warm)
+    {
+        return cache;
+    }
+
+    //warm whole shadow with one sequential read
+    if (read_polled(cache, 0, cache->image, size_words) < 0)
+    {
+        eeprom_cache_destroy(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+//Public specification in header
+void eeprom_cache_destroy(eeprom_cache_t *cache)
+{
+    if (cache == NULL)
+    {
+        return;
+    }
+    if (cache->timer_running)
+    {
+        pthread_mutex_lock(&cache->timer_wait);
+        cache->timer_running = 0;
+        pthread_cond_signal(&cache->timer_cond);
+        pthread_mutex_unlock(&cache->timer_wait);
+        pthread_join(cache->timer, NULL);
+        pthread_cond_destroy(&cache->timer_cond);
+        pthread_mutex_destroy(&cache->timer_wait);
+    }
+    if (cache->owned)
+    {
+        free(cache->dirty); //start of storage
+    }
+    free(cache);
+}
+
+//Public specification in header
+int eeprom_cache_read(eeprom_cache_t *cache, uint32_t addr, char *buf, int len)
+{
+    if (len <= 0)
+    {
+        return 0;
+    }
+    const uint32_t first   = eeprom_geom_page(&cache->geom, addr);
+    const uint32_t last    = eeprom_geom_page(&cache->geom, addr + len - 1);
+    int            retries = 0;
+    int            busy;
+    while (1)
+    {
+        uint64_t before = seq_sum(cache, first, last, &busy);
+        if (!busy)
+        {
+            memcpy(buf, cache->image + addr, len);
+            //copy complete before counts are checked again
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (seq_sum(cache, first, last, &busy) == before)
+            {
+                return retries;
+            }
+        }
+        if (++retries == SPIN_LIMIT)
+        {
+            return -EAGAIN; //writer stalled or gone, caller locks
+        }
+    }
+}
+
+//Public specification in header
+int eeprom_cache_repair(eeprom_cache_t *cache)
+{
+    uint32_t page;
+    int      repaired = 0;
+    for (page = 0; page < cache->num_pages; page++)
+    {
+        if (!(__atomic_load_n(&cache->seq[page], __ATOMIC_RELAXED) & 1))
+        {
+            continue;
+        }
+
+        //store was cut short, take the page back from the device
+        uint32_t addr = eeprom_geom_start(&cache->geom, page);
+        uint32_t len  = cache->geom.page;
+        if (addr + len > cache->size_words) //short last page
+        {
+            len = cache->size_words - addr;
+        }
+        int e = read_polled(cache, addr, cache->image + addr, len);
+        if (e < 0)
+        {
+            return e; //page stays held
+        }
+        __atomic_fetch_and(&cache->dirty[page/BITS_PER_WORD],
+            ~((uint64_t)1 << (page % BITS_PER_WORD)), __ATOMIC_RELAXED);
+        seq_write(cache, page, page, 1);
+        repaired++;
+    }
+    return repaired;
+}
+
+//Public specification in header
+int eeprom_cache_generation(eeprom_cache_t *cache, uint32_t addr, int len, uint64_t *gen)
+{
+    int busy;
+    *gen = seq_sum(cache, eeprom_geom_page(&cache->geom, addr),
+        eeprom_geom_page(&cache->geom, addr + len - 1), &busy);
+    return busy;
+}
+
+//Public specification in header
+int eeprom_cache_write(eeprom_cache_t *cache, uint32_t addr, const char *buf, int len)
+{
+    if (len <= 0)
+    {
+        return 0;
+    }
+    const uint32_t first = eeprom_geom_page(&cache->geom, addr);
+    const uint32_t last  = eeprom_geom_page(&cache->geom, addr + len - 1);
+    uint32_t lo, hi;
+    if (!cache->elide)
+    {
+        seq_write(cache, first, last, 0);
+        memcpy(cache->image + addr, buf, len);
+        seq_write(cache, first, last, 1);
+        mark_dirty(cache, first, last);
+        return 0;
+    }
+    if (!eeprom_diff_span(buf, cache->image + addr, len, &lo, &hi))
+    {
+        return last - first + 1; //identical, readers undisturbed
+    }
+
+    //compare page by page, only changed pages become dirty
+    uint32_t page;
+    uint32_t done  = 0;
+    int      clean = 0;
+    seq_write(cache, first, last, 0);
+    for (page = first; page <= last; page++)
+    {
+        uint32_t end = eeprom_geom_start(&cache->geom, page + 1);
+        uint32_t n   = (end - addr - done < len - done) ? end - addr - done : len - done;
+        if (eeprom_diff_span(buf + done, cache->image + addr + done, n, &lo, &hi))
+        {
+            memcpy(cache->image + addr + done + lo, buf + done + lo, hi - lo + 1);
+            mark_dirty(cache, page, page);
+        }
+        else
+        {
+            clean++;
+        }
+        done += n;
+    }
+    seq_write(cache, first, last, 1);
+    return clean;
+}
+
+//Public specification in header
+int eeprom_cache_flush(eeprom_cache_t *cache,
+    int (*program)(void*, uint32_t, const char*, int), void *arg)
+{
+    uint32_t word;
+    int      programs = 0;
+    int      result   = 0;
+    for (word = 0; word*BITS_PER_WORD < cache->num_pages; word++)
+    {
+        //skip 64 clean pages at a time
+        uint64_t bits = __atomic_load_n(&cache->dirty[word], __ATOMIC_RELAXED);
+        while (bits)
+        {
+            uint32_t page = word*BITS_PER_WORD + __builtin_ctzll(bits);
+            uint64_t bit  = bits & -bits;
+            bits &= bits - 1;
+
+            uint32_t addr = eeprom_geom_start(&cache->geom, page);
+            uint32_t len  = cache->geom.page;
+            if (addr + len > cache->size_words) //short last page
+            {
+                len = cache->size_words - addr;
+            }
+            int e = program(arg, addr, cache->image + addr, len);
+            if (e < 0)
+            {
+                result = e; //page stays dirty
+                continue;
+            }
+            __atomic_fetch_and(&cache->dirty[word], ~bit, __ATOMIC_RELAXED);
+            programs++;
+        }
+    }
+    return (result < 0) ? result : programs;
+}
+
+//----------------------------------------------------------
+// flush_timer
+//
+// Periodic flush thread body.
+//----------------------------------------------------------
+// @param[in]  : arg - eeprom_cache_t being flushed
+//
+static void *flush_timer(void *arg)
+{
+    eeprom_cache_t *cache = arg;
+    pthread_mutex_lock(&cache->timer_wait);
+    while (cache->timer_running)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += cache->timer_ms / 1000;
+        deadline.tv_nsec += (long)(cache->timer_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&cache->timer_cond, &cache->timer_wait,
+                &deadline) == ETIMEDOUT)
+        {
+            pthread_mutex_unlock(&cache->timer_wait);
+            cache->timer_flush(cache->timer_arg);
+            pthread_mutex_lock(&cache->timer_wait);
+        }
+    }
+    pthread_mutex_unlock(&cache->timer_wait);
+    return NULL;
+}
+
+//Public specification in header
+int eeprom_cache_start_timer(eeprom_cache_t *cache, int (*flush)(void*),
+    void *arg, uint32_t interval_ms)
+{
+    if ((cache == NULL) || (flush == NULL) || (interval_ms == 0))
+    {
+        return -EINVAL;
+    }
+    if (cache->timer_running)
+    {
+        return -EBUSY;
+    }
+    cache->timer_flush   = flush;
+    cache->timer_arg     = arg;
+    cache->timer_ms      = interval_ms;
+    cache->timer_running = 1;
+    pthread_mutex_init(&cache->timer_wait, NULL);
+    pthread_cond_init(&cache->timer_cond, NULL);
+    if (pthread_create(&cache->timer, NULL, flush_timer, cache) != 0)
+    {
+        cache->timer_running = 0;
+        pthread_cond_destroy(&cache->timer_cond);
+        pthread_mutex_destroy(&cache->timer_wait);
+        return -EAGAIN;
+    }
+    return 0; //success
+}
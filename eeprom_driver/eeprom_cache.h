@@ -0,0 +1,229 @@
+/* eeprom_cache.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_cache_h
+#define _eeprom_cache_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "device/eeprom_device.h"
+#include "eeprom_geom.h"
+
+//In-RAM write-back shadow of a whole device. Writers serialize
+//access to each page with the owning device's lock; dirty bits
+//are updated atomically so writers of different pages may run
+//concurrently. Readers take no lock: each page carries a
+//sequence count, odd while a write is in progress, and a read
+//is retried until it copies without any page count changing.
+typedef struct eeprom_cache
+{
+    //shadowed hardware tier device
+    eeprom_device_t *hw;
+
+    //shadow geometry
+    uint32_t      size_words;
+    eeprom_geom_t geom;
+    uint32_t      num_pages;
+
+    //device contents, size_words bytes
+    char *image;
+
+    //one bit per page, set when image differs from device
+    uint64_t *dirty;
+
+    //per page sequence count, see eeprom_cache_read
+    uint64_t *seq;
+
+    //image, dirty and seq were allocated by eeprom_cache_create
+    //rather than supplied to eeprom_cache_attach
+    int owned;
+
+    //only dirty pages whose contents a write actually changes
+    int elide;
+
+    //owner's counter of ACK polls, may be NULL
+    uint64_t *ack_polls;
+
+    //periodic flush thread, see eeprom_cache_start_timer
+    pthread_t        timer;
+    int            (*timer_flush)(void*);
+    void            *timer_arg;
+    pthread_mutex_t  timer_wait;
+    pthread_cond_t   timer_cond;
+    uint32_t         timer_ms;
+    int              timer_running;
+
+} eeprom_cache_t;
+
+
+//----------------------------------------------------------
+// eeprom_cache_create
+//
+// Allocates a shadow of size_words bytes and fills it from the
+// open hardware tier device with one sequential read. Device
+// transactions ACK-poll while the part is in a write cycle.
+//----------------------------------------------------------
+// @param[in]  : hw              - open device handle
+// @param[in]  : size_words      - bytes to shadow from address 0
+// @param[in]  : page_size_bytes - device page size
+// @param[in]  : elide           - skip dirtying unchanged pages
+// @param[in]  : ack_polls       - counter of polls, may be NULL
+// @param[out] : eeprom_cache_t* - new cache, NULL on failure
+//
+eeprom_cache_t *eeprom_cache_create(eeprom_device_t *hw, uint32_t size_words,
+    uint32_t page_size_bytes, int elide, uint64_t *ack_polls);
+
+
+//----------------------------------------------------------
+// eeprom_cache_storage
+//
+// Returns bytes of storage eeprom_cache_attach needs for the
+// contents, dirty bits and sequence counts of a shadow.
+//----------------------------------------------------------
+// @param[in]  : size_words      - bytes to shadow from address 0
+// @param[in]  : page_size_bytes - device page size
+// @param[out] : size_t          - storage bytes
+//
+size_t eeprom_cache_storage(uint32_t size_words, uint32_t page_size_bytes);
+
+
+//----------------------------------------------------------
+// eeprom_cache_attach
+//
+// As eeprom_cache_create, but the shadow lives in caller owned,
+// 8 byte aligned storage of eeprom_cache_storage bytes, such as
+// shared memory, so caches in several processes can be views of
+// one shadow. Storage must start zeroed; it is filled from the
+// device only when warm is set, otherwise it already holds a
+// shadow of the device. Storage is not freed on destroy.
+//----------------------------------------------------------
+// @param[in]  : hw              - open device handle
+// @param[in]  : size_words      - bytes to shadow from address 0
+// @param[in]  : page_size_bytes - device page size
+// @param[in]  : elide           - skip dirtying unchanged pages
+// @param[in]  : ack_polls       - counter of polls, may be NULL
+// @param[in]  : storage         - shadow storage, NULL to allocate
+// @param[in]  : warm            - nonzero to fill storage from device
+// @param[out] : eeprom_cache_t* - new cache, NULL on failure
+//
+eeprom_cache_t *eeprom_cache_attach(eeprom_device_t *hw, uint32_t size_words,
+    uint32_t page_size_bytes, int elide, uint64_t *ack_polls, void *storage, int warm);
+
+
+//----------------------------------------------------------
+// eeprom_cache_destroy
+//
+// Stops the flush timer and frees the cache. Dirty pages are
+// discarded; flush first to keep them.
+//----------------------------------------------------------
+// @param[in]  : cache - cache to free
+//
+void eeprom_cache_destroy(eeprom_cache_t *cache);
+
+
+//----------------------------------------------------------
+// eeprom_cache_read
+//
+// Copies len bytes starting at addr out of the shadow without
+// taking any lock. The copy is retried while a writer holds or
+// changes any page in range, so it never mixes bytes from before
+// and after one eeprom_cache_write. A range that stays held is
+// given up on, and should be read again under the device lock.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[in]  : addr  - effective device address
+// @param[in]  : buf   - destination buffer
+// @param[in]  : len   - number of bytes
+// @param[out] : int   - number of retries, -EAGAIN if given up
+//
+int eeprom_cache_read(eeprom_cache_t *cache, uint32_t addr, char *buf, int len);
+
+
+//----------------------------------------------------------
+// eeprom_cache_repair
+//
+// Finishes stores left half done by a writer that died holding
+// the device lock: every page whose sequence count is odd is read
+// back from the device, marked clean and released to readers.
+// Called with the device lock held.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[out] : int   - pages repaired, negative on error
+//
+int eeprom_cache_repair(eeprom_cache_t *cache);
+
+
+//----------------------------------------------------------
+// eeprom_cache_generation
+//
+// Sums the sequence counts of every page covering len bytes at
+// addr. The sum changes whenever a write to the range starts or
+// finishes, so bytes consumed in place from cache->image are
+// consistent if the sum is the same before and after.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[in]  : addr  - effective device address
+// @param[in]  : len   - number of bytes, at least 1
+// @param[in]  : gen   - receives sum of sequence counts
+// @param[out] : int   - nonzero while a write to the range is in progress
+//
+int eeprom_cache_generation(eeprom_cache_t *cache, uint32_t addr, int len, uint64_t *gen);
+
+
+//----------------------------------------------------------
+// eeprom_cache_write
+//
+// Copies len bytes into the shadow at addr and marks every
+// page touched dirty, or with elide only the pages whose
+// contents change. No device transaction is issued.
+//----------------------------------------------------------
+// @param[in]  : cache - device shadow
+// @param[in]  : addr  - effective device address
+// @param[in]  : buf   - source buffer
+// @param[in]  : len   - number of bytes
+// @param[out] : int   - touched pages whose contents were unchanged
+//
+int eeprom_cache_write(eeprom_cache_t *cache, uint32_t addr, const char *buf, int len);
+
+
+//----------------------------------------------------------
+// eeprom_cache_flush
+//
+// Programs each dirty page back to the device with a single
+// page write and clears its dirty bit. Pages that fail stay
+// dirty. Page writes go through the owner's program routine,
+// which ACK-polls, retries and counts them as it would any
+// other page write.
+//----------------------------------------------------------
+// @param[in]  : cache   - device shadow
+// @param[in]  : program - program(arg, addr, buf, len) page write
+// @param[in]  : arg     - argument passed to program
+// @param[out] : int     - number of pages programmed, negative on error
+//
+int eeprom_cache_flush(eeprom_cache_t *cache,
+    int (*program)(void*, uint32_t, const char*, int), void *arg);
+
+
+//----------------------------------------------------------
+// eeprom_cache_start_timer
+//
+// Starts a thread that calls flush(arg) every interval_ms
+// milliseconds until the cache is destroyed. flush is expected
+// to take the owning device's lock and call eeprom_cache_flush.
+//----------------------------------------------------------
+// @param[in]  : cache       - device shadow
+// @param[in]  : flush       - locked flush routine
+// @param[in]  : arg         - argument passed to flush
+// @param[in]  : interval_ms - flush period
+// @param[out] : int         - 0 on success
+//
+int eeprom_cache_start_timer(eeprom_cache_t *cache, int (*flush)(void*),
+    void *arg, uint32_t interval_ms);
+
+
+#endif
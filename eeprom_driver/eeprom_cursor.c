@@ -0,0 +1,262 @@
+/* eeprom_cursor.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_cursor.h"
+#include "eeprom_async.h"
+
+//----------------------------------------------------------
+// fill_done
+//
+// eeprom_complete_t for a prefetch, runs on the async worker.
+//----------------------------------------------------------
+// @param[in]  : ctx    - buffer filled
+// @param[in]  : result - eeprom_read return value
+//
+static void fill_done(void *ctx, int result)
+{
+    eeprom_cursor_buf_t *b = ctx;
+    eeprom_cursor_t     *c = b->owner;
+    pthread_mutex_lock(&c->lock);
+    b->result = result;
+    b->state  = EEPROM_CURSOR_READY;
+    pthread_cond_broadcast(&c->filled);
+    pthread_mutex_unlock(&c->lock);
+}
+
+//----------------------------------------------------------
+// reader_main
+//
+// Cursor's own prefetch thread, used when the device has no
+// asynchronous queue. Reads each pending buffer until stopped.
+//----------------------------------------------------------
+// @param[in]  : arg   - cursor
+// @param[out] : void* - NULL
+//
+static void *reader_main(void *arg)
+{
+    eeprom_cursor_t *c = arg;
+    pthread_mutex_lock(&c->lock);
+    while (1)
+    {
+        while (!c->stop && (c->pending == NULL))
+        {
+            pthread_cond_wait(&c->wake, &c->lock);
+        }
+        if (c->stop)
+        {
+            break;
+        }
+        eeprom_cursor_buf_t *b = c->pending;
+        c->pending = NULL;
+        pthread_mutex_unlock(&c->lock);
+        fill_done(b, eeprom_read(c->dev, b->off, b->len, b->data));
+        pthread_mutex_lock(&c->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+//----------------------------------------------------------
+// start_fill
+//
+// Assigns the window at off to b and queues its read, on the
+// device's asynchronous queue when it has one running and else
+// on the cursor's reader thread. A read that cannot be queued
+// leaves b empty to be read on demand by take_fill.
+//----------------------------------------------------------
+// @param[in]  : c   - cursor
+// @param[in]  : b   - idle buffer of c
+// @param[in]  : off - base relative window start, below c->end
+//
+static void start_fill(eeprom_cursor_t *c, eeprom_cursor_buf_t *b, uint32_t off)
+{
+    b->off    = off;
+    b->len    = (c->end - off < c->window) ? c->end - off : c->window;
+    b->state  = EEPROM_CURSOR_EMPTY;
+    b->result = 0;
+    if (c->dev->async == NULL)
+    {
+        if (c->reading)
+        {
+            pthread_mutex_lock(&c->lock);
+            b->state   = EEPROM_CURSOR_INFLIGHT;
+            c->pending = b;
+            pthread_cond_signal(&c->wake);
+            pthread_mutex_unlock(&c->lock);
+        }
+        return;
+    }
+    b->state = EEPROM_CURSOR_INFLIGHT;
+    if (eeprom_submit_read(c->dev, b->off, b->len, b->data, fill_done, b) < 0)
+    {
+        b->state = EEPROM_CURSOR_EMPTY; //queue full, read on demand
+    }
+}
+
+//----------------------------------------------------------
+// take_fill
+//
+// Waits for b's prefetch, or reads it now if none was queued.
+//----------------------------------------------------------
+// @param[in]  : c   - cursor
+// @param[in]  : b   - buffer assigned by start_fill
+// @param[out] : int - eeprom_read result
+//
+static int take_fill(eeprom_cursor_t *c, eeprom_cursor_buf_t *b)
+{
+    pthread_mutex_lock(&c->lock);
+    if (b->state == EEPROM_CURSOR_EMPTY)
+    {
+        pthread_mutex_unlock(&c->lock);
+        b->result = eeprom_read(c->dev, b->off, b->len, b->data);
+        b->state  = EEPROM_CURSOR_READY;
+        return b->result;
+    }
+    while (b->state != EEPROM_CURSOR_READY)
+    {
+        pthread_cond_wait(&c->filled, &c->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return b->result;
+}
+
+//Public specification in header
+int eeprom_cursor_open(eeprom_dev_t *dev, uint32_t offset, uint32_t len,
+    uint32_t window, eeprom_cursor_t **cursor)
+{
+    if ((dev == NULL) || (dev->hw == NULL))
+    {
+        return -ENODEV;
+    }
+    if ((cursor == NULL) || (window == 0) ||
+        (offset > dev->properties.device_size_words) ||
+        (len > dev->properties.device_size_words - offset))
+    {
+        return -EINVAL;
+    }
+    const uint32_t page = dev->properties.page_size_bytes;
+
+    eeprom_cursor_t *c = calloc(1, sizeof(eeprom_cursor_t));
+    if (c == NULL)
+    {
+        return -ENOMEM;
+    }
+    c->dev    = dev;
+    c->end    = offset + len;
+    c->window = ((window + page - 1) / page) * page;
+    c->buf[0].owner = c;
+    c->buf[1].owner = c;
+    c->buf[0].data  = malloc(c->window);
+    c->buf[1].data  = malloc(c->window);
+    if ((c->buf[0].data == NULL) || (c->buf[1].data == NULL))
+    {
+        free(c->buf[0].data);
+        free(c->buf[1].data);
+        free(c);
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->filled, NULL);
+    pthread_cond_init(&c->wake, NULL);
+    if (dev->async == NULL)
+    {
+        //no queue, own reader thread reads the next window ahead;
+        //if it cannot start, windows are read on demand
+        c->reading = (pthread_create(&c->reader, NULL, reader_main, c) == 0);
+    }
+
+    //buf[0] starts drained, so the first next switches to buf[1]
+    c->cur         = 0;
+    c->pos         = 0;
+    c->buf[0].off  = offset;
+    c->buf[0].len  = 0;
+    if (offset < c->end)
+    {
+        start_fill(c, &c->buf[1], offset);
+    }
+    *cursor = c;
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_cursor_next(eeprom_cursor_t *cursor, char *buf, int max)
+{
+    if ((cursor == NULL) || (buf == NULL) || (max < 0))
+    {
+        return -EINVAL;
+    }
+    eeprom_cursor_t *c    = cursor;
+    int              done = 0;
+    while (done < max)
+    {
+        eeprom_cursor_buf_t *b = &c->buf[c->cur];
+        if (c->pos == b->len)
+        {
+            if (b->result < 0)
+            {
+                return b->result; //failed window stays failed
+            }
+            //drained, switch buffers once the next window is in
+            uint32_t next = b->off + b->len;
+            if (next >= c->end)
+            {
+                break; //end of region
+            }
+            c->cur = !c->cur;
+            c->pos = 0;
+            b      = &c->buf[c->cur];
+            int e  = take_fill(c, b);
+            if (e < 0)
+            {
+                b->len = 0;
+                return e;
+            }
+            //refill the drained buffer while the caller works
+            if (b->off + b->len < c->end)
+            {
+                start_fill(c, &c->buf[!c->cur], b->off + b->len);
+            }
+            continue;
+        }
+        int n = (b->len - c->pos < max - done) ? b->len - c->pos : max - done;
+        memcpy(buf + done, b->data + c->pos, n);
+        c->pos += n;
+        done   += n;
+    }
+    return done;
+}
+
+//Public specification in header
+int eeprom_cursor_close(eeprom_cursor_t *cursor)
+{
+    if (cursor == NULL)
+    {
+        return -EINVAL;
+    }
+    //a prefetch may still be writing into a buffer; states are
+    //only read under the lock its completion is signalled with
+    eeprom_cursor_t *c = cursor;
+    pthread_mutex_lock(&c->lock);
+    while ((c->buf[0].state == EEPROM_CURSOR_INFLIGHT) ||
+           (c->buf[1].state == EEPROM_CURSOR_INFLIGHT))
+    {
+        pthread_cond_wait(&c->filled, &c->lock);
+    }
+    c->stop = 1;
+    pthread_cond_signal(&c->wake);
+    pthread_mutex_unlock(&c->lock);
+    if (c->reading)
+    {
+        pthread_join(c->reader, NULL);
+    }
+    pthread_cond_destroy(&cursor->wake);
+    pthread_cond_destroy(&cursor->filled);
+    pthread_mutex_destroy(&cursor->lock);
+    free(cursor->buf[0].data);
+    free(cursor->buf[1].data);
+    free(cursor);
+    return 0; //success
+}
@@ -0,0 +1,117 @@
+/* eeprom_cursor.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_cursor_h
+#define _eeprom_cursor_h
+
+#include "eeprom.h"
+
+//Read-ahead buffer states
+#define EEPROM_CURSOR_EMPTY    0 //not filled, read on demand
+#define EEPROM_CURSOR_INFLIGHT 1 //prefetch queued or being read
+#define EEPROM_CURSOR_READY    2 //filled, result valid
+
+//One read-ahead buffer, passed as the async completion context
+typedef struct eeprom_cursor_buf
+{
+    struct eeprom_cursor *owner;
+
+    //window bytes, base relative location and length of contents
+    char    *data;
+    uint32_t off;
+    uint32_t len;
+
+    //EEPROM_CURSOR_* and eeprom_read result once READY
+    int state;
+    int result;
+
+} eeprom_cursor_buf_t;
+
+//Sequential reader over [offset, offset+len) of one device. Two
+//window sized buffers alternate: the caller drains one while
+//the other is prefetched through dev's asynchronous queue, or
+//without a running queue by a reader thread the cursor starts
+//for itself. A window whose prefetch could not be queued is
+//read on demand with one sequential transaction. A cursor
+//belongs to one thread.
+typedef struct eeprom_cursor
+{
+    eeprom_dev_t *dev;
+
+    //base relative end of region
+    uint32_t end;
+
+    //bytes per buffer fill, whole pages
+    uint32_t window;
+
+    //double buffer, cur is drained from pos
+    eeprom_cursor_buf_t buf[2];
+    int                 cur;
+    uint32_t            pos;
+
+    //prefetch completion, signalled from the async worker
+    pthread_mutex_t lock;
+    pthread_cond_t  filled;
+
+    //own reader thread when dev has no queue, takes pending
+    pthread_t            reader;
+    pthread_cond_t       wake;
+    eeprom_cursor_buf_t *pending;
+    int                  reading;
+    int                  stop;
+
+} eeprom_cursor_t;
+
+
+//----------------------------------------------------------
+// eeprom_cursor_open
+//
+// Open Read Cursor:
+// Positions a new cursor at offset and starts prefetching the
+// first window, through dev's asynchronous queue when one is
+// running or else on the cursor's own reader thread.
+//----------------------------------------------------------
+// @param[in]  : dev    - open process independent device struct
+// @param[in]  : offset - base relative start of region
+// @param[in]  : len    - bytes in region
+// @param[in]  : window - read-ahead bytes, rounded up to pages
+// @param[in]  : cursor - receives new cursor
+// @param[out] : int    - 0 on success
+//
+int eeprom_cursor_open(eeprom_dev_t *dev, uint32_t offset, uint32_t len,
+    uint32_t window, eeprom_cursor_t **cursor);
+
+
+//----------------------------------------------------------
+// eeprom_cursor_next
+//
+// Read Next Chunk:
+// Copies up to max bytes following the previous chunk into buf.
+// Whenever a buffer is drained the cursor switches to the other
+// and queues the window after it.
+//----------------------------------------------------------
+// @param[in]  : cursor - open cursor
+// @param[in]  : buf    - destination buffer
+// @param[in]  : max    - chunk size in bytes
+// @param[out] : int    - bytes copied, 0 at end, negative on error
+//
+int eeprom_cursor_next(eeprom_cursor_t *cursor, char *buf, int max);
+
+
+//----------------------------------------------------------
+// eeprom_cursor_close
+//
+// Close Read Cursor:
+// Waits for any prefetch still in flight, stops the reader
+// thread and frees cursor.
+//----------------------------------------------------------
+// @param[in]  : cursor - cursor to free
+// @param[out] : int    - 0 on success
+//
+int eeprom_cursor_close(eeprom_cursor_t *cursor);
+
+
+#endif
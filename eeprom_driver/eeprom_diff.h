@@ -0,0 +1,67 @@
+/* eeprom_diff.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_diff_h
+#define _eeprom_diff_h
+
+#include <stdint.h>
+#include <string.h>
+
+//----------------------------------------------------------
+// eeprom_diff_span
+//
+// Finds the first and last byte at which a and b differ,
+// comparing 64 bits at a time. Used to elide page programs
+// whose contents would not change.
+//----------------------------------------------------------
+// @param[in]  : a     - incoming bytes
+// @param[in]  : b     - current bytes
+// @param[in]  : len   - number of bytes compared
+// @param[in]  : first - receives index of first difference
+// @param[in]  : last  - receives index of last difference
+// @param[out] : int   - 1 if a and b differ, else 0
+//
+static inline int eeprom_diff_span(const char *a, const char *b, uint32_t len,
+    uint32_t *first, uint32_t *last)
+{
+    uint64_t x;
+    uint64_t y;
+    uint32_t lo = 0;
+    uint32_t hi = len;
+
+    //forward: skip equal words, then equal bytes
+    while ((lo + sizeof(x) <= len) &&
+        (memcpy(&x, a + lo, sizeof(x)), memcpy(&y, b + lo, sizeof(y)), x == y))
+    {
+        lo += sizeof(x);
+    }
+    while ((lo < len) && (a[lo] == b[lo]))
+    {
+        lo++;
+    }
+    if (lo == len)
+    {
+        return 0; //identical
+    }
+
+    //backward from the end, stopping at first difference
+    while ((hi >= lo + sizeof(x)) &&
+        (memcpy(&x, a + hi - sizeof(x), sizeof(x)),
+         memcpy(&y, b + hi - sizeof(y), sizeof(y)), x == y))
+    {
+        hi -= sizeof(x);
+    }
+    while (a[hi-1] == b[hi-1])
+    {
+        hi--;
+    }
+
+    *first = lo;
+    *last  = hi - 1;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,120 @@
+/* eeprom_geom.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_geom_h
+#define _eeprom_geom_h
+
+#include <stdint.h>
+#include <errno.h>
+
+//Page arithmetic done on every transaction. Every standard 24Cxx
+//part has a power of two page size, for which page index and
+//offset are a shift and a mask; other sizes take the generic
+//division. Building with -DEEPROM_PAGE_SHIFT=n fixes the page
+//size at 1 << n at compile time, so the arithmetic folds to
+//constants and devices of any other page size fail to open.
+typedef struct eeprom_geom
+{
+    //page size in bytes
+    uint32_t page;
+
+    //log2(page) and page-1, valid when pow2 is set
+    uint32_t shift;
+    uint32_t mask;
+    int      pow2;
+
+} eeprom_geom_t;
+
+
+//----------------------------------------------------------
+// eeprom_geom_init
+//
+// Selects the fast path for page_size_bytes.
+//----------------------------------------------------------
+// @param[in]  : geom            - geometry to fill
+// @param[in]  : page_size_bytes - device page size
+// @param[out] : int             - 0 on success
+//
+static inline int eeprom_geom_init(eeprom_geom_t *geom, uint32_t page_size_bytes)
+{
+    if (page_size_bytes == 0)
+    {
+        return -EINVAL;
+    }
+#ifdef EEPROM_PAGE_SHIFT
+    if (page_size_bytes != (1u << EEPROM_PAGE_SHIFT))
+    {
+        return -EINVAL; //built for one page size only
+    }
+#endif
+    geom->page  = page_size_bytes;
+    geom->pow2  = (page_size_bytes & (page_size_bytes - 1)) == 0;
+    geom->mask  = page_size_bytes - 1;
+    geom->shift = 0;
+    while ((1u << geom->shift) < page_size_bytes)
+    {
+        geom->shift++;
+    }
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// eeprom_geom_page
+//
+// Page holding addr, or whole pages in a byte count.
+//----------------------------------------------------------
+// @param[in]  : geom - device geometry
+// @param[in]  : addr - device address or byte count
+// @param[out] : uint32_t - addr / page size
+//
+static inline uint32_t eeprom_geom_page(const eeprom_geom_t *geom, uint32_t addr)
+{
+#ifdef EEPROM_PAGE_SHIFT
+    return addr >> EEPROM_PAGE_SHIFT;
+#else
+    return geom->pow2 ? (addr >> geom->shift) : (addr / geom->page);
+#endif
+}
+
+//----------------------------------------------------------
+// eeprom_geom_offset
+//
+// Position of addr within its page, or bytes past the last
+// whole page in a byte count.
+//----------------------------------------------------------
+// @param[in]  : geom - device geometry
+// @param[in]  : addr - device address or byte count
+// @param[out] : uint32_t - addr % page size
+//
+static inline uint32_t eeprom_geom_offset(const eeprom_geom_t *geom, uint32_t addr)
+{
+#ifdef EEPROM_PAGE_SHIFT
+    return addr & ((1u << EEPROM_PAGE_SHIFT) - 1);
+#else
+    return geom->pow2 ? (addr & geom->mask) : (addr % geom->page);
+#endif
+}
+
+//----------------------------------------------------------
+// eeprom_geom_start
+//
+// First address of a page.
+//----------------------------------------------------------
+// @param[in]  : geom - device geometry
+// @param[in]  : page - page index
+// @param[out] : uint32_t - page * page size
+//
+static inline uint32_t eeprom_geom_start(const eeprom_geom_t *geom, uint32_t page)
+{
+#ifdef EEPROM_PAGE_SHIFT
+    return page << EEPROM_PAGE_SHIFT;
+#else
+    return geom->pow2 ? (page << geom->shift) : (page * geom->page);
+#endif
+}
+
+
+#endif
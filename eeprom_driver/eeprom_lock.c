@@ -0,0 +1,116 @@
+/* eeprom_lock.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_lock.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+//----------------------------------------------------------
+// stripe_in_range
+//
+// Checks whether stripe guards any page in [first, last].
+//----------------------------------------------------------
+// @param[in]  : lock   - striped page lock
+// @param[in]  : stripe - stripe index
+// @param[in]  : first  - first page touched
+// @param[in]  : last   - last page touched
+// @param[out] : int    - nonzero if stripe must be held
+//
+static int stripe_in_range(eeprom_lock_t *lock, uint32_t stripe,
+    uint32_t first, uint32_t last)
+{
+    const uint32_t n = lock->num_stripes;
+    if (last - first + 1 >= n) //range wraps every stripe
+    {
+        return 1;
+    }
+    uint32_t lo = first % n;
+    uint32_t hi = last % n;
+    if (lo <= hi)
+    {
+        return (stripe >= lo) && (stripe <= hi);
+    }
+    return (stripe >= lo) || (stripe <= hi); //wrapped past stripe n-1
+}
+
+//Public specification in header
+int eeprom_lock_init(eeprom_lock_t *lock, uint32_t num_stripes,
+    uint32_t page_size_bytes)
+{
+    if ((lock == NULL) || (num_stripes == 0) ||
+        (eeprom_geom_init(&lock->geom, page_size_bytes) < 0))
+    {
+        return -EINVAL;
+    }
+    lock->stripes = calloc(num_stripes, sizeof(pthread_rwlock_t));
+    if (lock->stripes == NULL)
+    {
+        return -ENOMEM;
+    }
+    uint32_t i;
+    for (i = 0; i < num_stripes; i++)
+    {
+        pthread_rwlock_init(&lock->stripes[i], NULL);
+    }
+    lock->num_stripes = num_stripes;
+    return 0; //success
+}
+
+//Public specification in header
+void eeprom_lock_destroy(eeprom_lock_t *lock)
+{
+    if ((lock == NULL) || (lock->stripes == NULL))
+    {
+        return;
+    }
+    uint32_t i;
+    for (i = 0; i < lock->num_stripes; i++)
+    {
+        pthread_rwlock_destroy(&lock->stripes[i]);
+    }
+    free(lock->stripes);
+    lock->stripes     = NULL;
+    lock->num_stripes = 0;
+}
+
+//Public specification in header
+void eeprom_lock_range(eeprom_lock_t *lock, uint32_t addr, uint32_t len, int write)
+{
+    const uint32_t first = eeprom_geom_page(&lock->geom, addr);
+    const uint32_t last  = eeprom_geom_page(&lock->geom, addr + len - 1);
+    uint32_t stripe;
+    for (stripe = 0; stripe < lock->num_stripes; stripe++)
+    {
+        if (!stripe_in_range(lock, stripe, first, last))
+        {
+            continue;
+        }
+        if (write)
+        {
+            pthread_rwlock_wrlock(&lock->stripes[stripe]);
+        }
+        else
+        {
+            pthread_rwlock_rdlock(&lock->stripes[stripe]);
+        }
+    }
+}
+
+//Public specification in header
+void eeprom_unlock_range(eeprom_lock_t *lock, uint32_t addr, uint32_t len)
+{
+    const uint32_t first = eeprom_geom_page(&lock->geom, addr);
+    const uint32_t last  = eeprom_geom_page(&lock->geom, addr + len - 1);
+    uint32_t stripe;
+    for (stripe = 0; stripe < lock->num_stripes; stripe++)
+    {
+        if (stripe_in_range(lock, stripe, first, last))
+        {
+            pthread_rwlock_unlock(&lock->stripes[stripe]);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/* eeprom_lock.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_lock_h
+#define _eeprom_lock_h
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "eeprom_geom.h"
+
+//Reader/writer locks striped by page. Page p is guarded by
+//stripe p % num_stripes, so readers run in parallel and writers
+//only exclude transactions touching the same stripes. One stripe
+//degenerates to a single device wide reader/writer lock. Shared
+//by every device struct addressing the same device, like the
+//device mutex.
+typedef struct eeprom_lock
+{
+    pthread_rwlock_t *stripes;
+    uint32_t          num_stripes;
+    eeprom_geom_t     geom;
+
+} eeprom_lock_t;
+
+
+//----------------------------------------------------------
+// eeprom_lock_init
+//
+// Allocates and initializes num_stripes page locks.
+//----------------------------------------------------------
+// @param[in]  : lock            - lock to initialize
+// @param[in]  : num_stripes     - number of reader/writer locks
+// @param[in]  : page_size_bytes - device page size
+// @param[out] : int             - 0 on success
+//
+int eeprom_lock_init(eeprom_lock_t *lock, uint32_t num_stripes,
+    uint32_t page_size_bytes);
+
+
+//----------------------------------------------------------
+// eeprom_lock_destroy
+//
+// Frees stripes allocated by eeprom_lock_init. No range may be
+// held.
+//----------------------------------------------------------
+// @param[in]  : lock - lock to destroy
+//
+void eeprom_lock_destroy(eeprom_lock_t *lock);
+
+
+//----------------------------------------------------------
+// eeprom_lock_range
+//
+// Acquires every stripe covering pages of [addr, addr+len), in
+// ascending stripe order so overlapping callers cannot deadlock.
+//----------------------------------------------------------
+// @param[in]  : lock  - striped page lock
+// @param[in]  : addr  - effective device address
+// @param[in]  : len   - number of bytes, at least 1
+// @param[in]  : write - nonzero for exclusive access
+//
+void eeprom_lock_range(eeprom_lock_t *lock, uint32_t addr, uint32_t len, int write);
+
+
+//----------------------------------------------------------
+// eeprom_unlock_range
+//
+// Releases stripes acquired by eeprom_lock_range with the same
+// arguments.
+//----------------------------------------------------------
+// @param[in]  : lock  - striped page lock
+// @param[in]  : addr  - effective device address
+// @param[in]  : len   - number of bytes, at least 1
+//
+void eeprom_unlock_range(eeprom_lock_t *lock, uint32_t addr, uint32_t len);
+
+
+#endif
@@ -0,0 +1,73 @@
+/* eeprom_part.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_part.h"
+
+#include <strings.h>
+
+//Datasheet geometry of one part
+typedef struct eeprom_part
+{
+    const char *name;
+    uint32_t    size_bytes;
+    uint32_t    page_size_bytes;
+    uint32_t    block_size_words; //block-select blocks, 0 for none
+
+} eeprom_part_t;
+
+//Standard 24Cxx family, every part 8-bit words
+static const eeprom_part_t parts[] =
+{
+    { "24C01",      128,   8,     0 },
+    { "24C02",      256,   8,     0 },
+    { "24C04",      512,  16,   256 },
+    { "24C08",     1024,  16,   256 },
+    { "24C16",     2048,  16,   256 },
+    { "24C32",     4096,  32,     0 },
+    { "24C64",     8192,  32,     0 },
+    { "24C128",   16384,  64,     0 },
+    { "24C256",   32768,  64,     0 },
+    { "24C512",   65536, 128,     0 },
+    { "24C1024", 131072, 256, 65536 },
+    { "24CM01",  131072, 256, 65536 },
+    { "24CM02",  262144, 256, 65536 },
+};
+
+//Worst case tWR and fastest common SCL across the family
+#define PART_CLOCK_HZ       400000
+#define PART_WRITE_CYCLE_US 5000
+
+//Public specification in header
+int eeprom_part_lookup(const char *name, eeprom_dev_properties_t *props,
+    eeprom_device_timing_t *timing)
+{
+    size_t i;
+    if ((name == NULL) || (props == NULL))
+    {
+        return -EINVAL;
+    }
+    for (i = 0; i < sizeof(parts)/sizeof(parts[0]); i++)
+    {
+        if (strcasecmp(name, parts[i].name) != 0)
+        {
+            continue;
+        }
+        props->base_address      = 0;
+        props->device_size_bits  = parts[i].size_bytes * 8;
+        props->device_size_words = parts[i].size_bytes;
+        props->word_size_bits    = 8;
+        props->page_size_bytes   = parts[i].page_size_bytes;
+        props->bank_size_words   = 0; //one chip, see block_size_words
+        props->block_size_words  = parts[i].block_size_words;
+        if (timing != NULL)
+        {
+            timing->clock_hz       = PART_CLOCK_HZ;
+            timing->write_cycle_us = PART_WRITE_CYCLE_US;
+        }
+        return 0; //success
+    }
+    return -ENOENT;
+}
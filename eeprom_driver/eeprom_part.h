@@ -0,0 +1,29 @@
+/* eeprom_part.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_part_h
+#define _eeprom_part_h
+
+#include "eeprom.h"
+
+//----------------------------------------------------------
+// eeprom_part_lookup
+//
+// Fills properties, and optionally bus timing, for a standard
+// 24Cxx serial EEPROM by part name, e.g. "24C64". Vendor
+// prefixes and suffixes are not part of the name; parts with a
+// different geometry are still described field by field.
+//----------------------------------------------------------
+// @param[in]  : name   - part name, case insensitive
+// @param[in]  : props  - receives device properties
+// @param[in]  : timing - receives datasheet timing, may be NULL
+// @param[out] : int    - 0 on success, -ENOENT if unknown
+//
+int eeprom_part_lookup(const char *name, eeprom_dev_properties_t *props,
+    eeprom_device_timing_t *timing);
+
+
+#endif
@@ -0,0 +1,160 @@
+/* eeprom_sched.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_sched.h"
+
+//Public specification in header
+int eeprom_sched_init(eeprom_sched_t *sched)
+{
+    if (sched == NULL)
+    {
+        return -EINVAL;
+    }
+    memset(sched, 0, sizeof(eeprom_sched_t));
+    sched->tail = &sched->head;
+    if (pthread_mutex_init(&sched->lock, NULL) != 0)
+    {
+        return -ENOMEM;
+    }
+    if (pthread_cond_init(&sched->done, NULL) != 0)
+    {
+        pthread_mutex_destroy(&sched->lock);
+        return -ENOMEM;
+    }
+    return 0; //success
+}
+
+//Public specification in header
+void eeprom_sched_destroy(eeprom_sched_t *sched)
+{
+    if (sched == NULL)
+    {
+        return;
+    }
+    pthread_cond_destroy(&sched->done);
+    pthread_mutex_destroy(&sched->lock);
+}
+
+//----------------------------------------------------------
+// same_target
+//
+// Checks whether a group committed through one device struct
+// can carry a request submitted through the other: offsets
+// resolve to the same addresses, bounds and options match and
+// failures reach the same handler.
+//----------------------------------------------------------
+// @param[in]  : a   - device struct
+// @param[in]  : b   - device struct
+// @param[out] : int - nonzero if interchangeable
+//
+static int same_target(const eeprom_dev_t *a, const eeprom_dev_t *b)
+{
+    return (a == b) ||
+        ((a->hw == b->hw) &&
+         (a->properties.base_address == b->properties.base_address) &&
+         (a->properties.device_size_words == b->properties.device_size_words) &&
+         (a->flags == b->flags) &&
+         (a->fault_handler == b->fault_handler));
+}
+
+//----------------------------------------------------------
+// commit_group
+//
+// Commits a detached list of requests as one write and marks
+// each done. Called without the scheduler lock held.
+//----------------------------------------------------------
+// @param[in]  : dev    - combining writer's device struct
+// @param[in]  : group  - requests in arrival order
+// @param[in]  : count  - number of requests
+// @param[in]  : commit - group write function
+// @param[out] : int    - commit result
+//
+static int commit_group(eeprom_dev_t *dev, eeprom_sched_req_t *group, int count,
+    eeprom_sched_commit_t commit)
+{
+    eeprom_iovec_t *iov = malloc(count * sizeof(eeprom_iovec_t));
+    if (iov == NULL)
+    {
+        return -ENOMEM;
+    }
+    eeprom_sched_req_t *req;
+    int                 i = 0;
+    for (req = group; req != NULL; req = req->next)
+    {
+        iov[i++] = req->iov;
+    }
+    int e = commit(dev, iov, count);
+    free(iov);
+    return e;
+}
+
+//Public specification in header
+int eeprom_sched_write(eeprom_sched_t *sched, eeprom_dev_t *dev, uint32_t offset,
+    int size, char *buf, eeprom_sched_commit_t commit)
+{
+    eeprom_sched_req_t req = {
+        .dev    = dev,
+        .iov    = { offset, size, buf },
+        .result = 0,
+        .done   = 0,
+        .next   = NULL,
+    };
+
+    pthread_mutex_lock(&sched->lock);
+    *sched->tail = &req;
+    sched->tail  = &req.next;
+    while (!req.done)
+    {
+        if (sched->combining)
+        {
+            pthread_cond_wait(&sched->done, &sched->lock);
+            continue;
+        }
+
+        //become combiner: detach every queued request this device
+        //struct can commit, which includes req, and commit them
+        //for all their writers in arrival order
+        eeprom_sched_req_t  *group = NULL;
+        eeprom_sched_req_t **last  = &group;
+        eeprom_sched_req_t **link  = &sched->head;
+        eeprom_sched_req_t  *r;
+        int                  count = 0;
+        sched->tail = &sched->head;
+        while ((r = *link) != NULL)
+        {
+            if (same_target(dev, r->dev))
+            {
+                *link   = r->next;
+                r->next = NULL;
+                *last   = r;
+                last    = &r->next;
+                count++;
+            }
+            else
+            {
+                link        = &r->next;
+                sched->tail = link;
+            }
+        }
+        sched->combining = 1;
+        pthread_mutex_unlock(&sched->lock);
+
+        int e = commit_group(dev, group, count, commit);
+
+        pthread_mutex_lock(&sched->lock);
+        for (r = group; r != NULL; r = r->next)
+        {
+            r->result = e;
+            r->done   = 1;
+        }
+        sched->batches  += 1;
+        sched->requests += count;
+        sched->combining = 0;
+        pthread_cond_broadcast(&sched->done);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return req.result;
+}
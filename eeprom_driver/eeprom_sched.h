@@ -0,0 +1,95 @@
+/* eeprom_sched.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_sched_h
+#define _eeprom_sched_h
+
+#include "eeprom.h"
+
+//Applies a group of queued writes, later segments winning
+typedef int (*eeprom_sched_commit_t)(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt);
+
+//Pending write, lives on the submitting thread's stack
+typedef struct eeprom_sched_req
+{
+    eeprom_dev_t            *dev; //submitter, iov.offset is relative to its base
+    eeprom_iovec_t           iov;
+    int                      result;
+    int                      done;
+    struct eeprom_sched_req *next;
+
+} eeprom_sched_req_t;
+
+//Write-coalescing scheduler shared by every device struct
+//addressing the same device, like the device mutex. Writers
+//queue their request; whichever writer finds no commit in
+//progress takes every queued request and commits them as one
+//scatter-gather write on behalf of the others (flat combining).
+//Requests hitting the same page become one page program and
+//pages are programmed in one ascending sweep. A combiner only
+//takes requests from device structs that address the device
+//as it does and report faults to the same handler; the rest
+//wait for a combiner of their own.
+typedef struct eeprom_sched
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  done;
+
+    //queued requests in arrival order
+    eeprom_sched_req_t  *head;
+    eeprom_sched_req_t **tail;
+
+    //a writer is committing a group
+    int combining;
+
+    //groups committed and requests they carried
+    uint64_t batches;
+    uint64_t requests;
+
+} eeprom_sched_t;
+
+
+//----------------------------------------------------------
+// eeprom_sched_init
+//
+// Initializes an empty scheduler.
+//----------------------------------------------------------
+// @param[in]  : sched - scheduler to initialize
+// @param[out] : int   - 0 on success
+//
+int eeprom_sched_init(eeprom_sched_t *sched);
+
+
+//----------------------------------------------------------
+// eeprom_sched_destroy
+//
+// Releases scheduler resources. No write may be queued.
+//----------------------------------------------------------
+// @param[in]  : sched - scheduler to destroy
+//
+void eeprom_sched_destroy(eeprom_sched_t *sched);
+
+
+//----------------------------------------------------------
+// eeprom_sched_write
+//
+// Queues one write and returns once a group containing it has
+// been committed, by this thread or another. Called by
+// eeprom_write when dev->sched is set.
+//----------------------------------------------------------
+// @param[in]  : sched  - shared scheduler
+// @param[in]  : dev    - caller's device struct, commits its group
+// @param[in]  : offset - base relative write location
+// @param[in]  : size   - number of bytes to write, bounds checked
+// @param[in]  : buf    - data, read until return
+// @param[in]  : commit - applies a group under the device lock
+// @param[out] : int    - commit result of the group
+//
+int eeprom_sched_write(eeprom_sched_t *sched, eeprom_dev_t *dev, uint32_t offset,
+    int size, char *buf, eeprom_sched_commit_t commit);
+
+
+#endif
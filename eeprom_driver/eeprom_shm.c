@@ -0,0 +1,315 @@
+/* eeprom_shm.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_shm.h"
+#include "eeprom_cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_WAIT_NS    1000000 //between checks of a segment being created
+#define SHM_WAIT_TRIES 1000    //checks before giving up on its creator
+
+//header rounded up so the shadow storage is 8 byte aligned
+#define SHM_HEADER ((sizeof(eeprom_shm_t) + 7) & ~(size_t)7)
+
+//----------------------------------------------------------
+// shm_pause
+//
+// Waits briefly for another process to finish creating a
+// segment.
+//----------------------------------------------------------
+static void shm_pause(void)
+{
+    struct timespec ts = { 0, SHM_WAIT_NS };
+    nanosleep(&ts, NULL);
+}
+
+//----------------------------------------------------------
+// shm_reap
+//
+// Drops the attachments of processes that exited without
+// detaching. Called with the mutex held.
+//----------------------------------------------------------
+// @param[in]  : seg - mapped segment
+//
+static void shm_reap(eeprom_shm_t *seg)
+{
+    int i;
+    for (i = 0; i < EEPROM_SHM_PROCS; i++)
+    {
+        eeprom_shm_proc_t *p = &seg->procs[i];
+        if ((p->pid != 0) && (kill(p->pid, 0) < 0) && (errno == ESRCH))
+        {
+            seg->refs -= p->refs;
+            p->pid  = 0;
+            p->refs = 0;
+        }
+    }
+}
+
+//----------------------------------------------------------
+// shm_proc
+//
+// Finds the attachment slot of the calling process, claiming a
+// free one when it has none. Called with the mutex held.
+//----------------------------------------------------------
+// @param[in]  : seg                - mapped segment
+// @param[in]  : claim              - nonzero to claim a free slot
+// @param[out] : eeprom_shm_proc_t* - slot, NULL if none
+//
+static eeprom_shm_proc_t *shm_proc(eeprom_shm_t *seg, int claim)
+{
+    const pid_t        self = getpid();
+    eeprom_shm_proc_t *free_slot = NULL;
+    int                i;
+    for (i = 0; i < EEPROM_SHM_PROCS; i++)
+    {
+        if (seg->procs[i].pid == self)
+        {
+            return &seg->procs[i];
+        }
+        if ((seg->procs[i].pid == 0) && (free_slot == NULL))
+        {
+            free_slot = &seg->procs[i];
+        }
+    }
+    if (claim && (free_slot != NULL))
+    {
+        free_slot->pid  = self;
+        free_slot->refs = 0;
+        return free_slot;
+    }
+    return NULL;
+}
+
+//Public specification in header
+int eeprom_shm_lock(eeprom_shm_t *shm)
+{
+    int e = pthread_mutex_lock(&shm->mutex);
+    if (e == EOWNERDEAD)
+    {
+        //its holder is gone, so is its reference; what it left
+        //half done is repaired by the next device lock holder
+        pthread_mutex_consistent(&shm->mutex);
+        shm_reap(shm);
+        shm->recovered = 1;
+        return 0; //success
+    }
+    return (e == 0) ? 0 : -EIO;
+}
+
+//----------------------------------------------------------
+// shm_create
+//
+// Sizes, maps and initializes a segment this process created.
+//----------------------------------------------------------
+// @param[in]  : fd              - new empty segment
+// @param[in]  : bytes           - segment size
+// @param[in]  : size_words      - device size in bytes
+// @param[in]  : page_size_bytes - device page size
+// @param[in]  : cached          - nonzero if a shadow is reserved
+// @param[in]  : shm             - receives mapped segment
+// @param[out] : int             - 0 on success
+//
+static int shm_create(int fd, uint64_t bytes, uint32_t size_words,
+    uint32_t page_size_bytes, int cached, eeprom_shm_t **shm)
+{
+    if (ftruncate(fd, bytes) < 0)
+    {
+        return -EIO;
+    }
+    eeprom_shm_t *seg = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+    {
+        return -EIO;
+    }
+
+    //ftruncate zero filled counters and shadow
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    int e = pthread_mutex_init(&seg->mutex, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    if (e != 0)
+    {
+        munmap(seg, bytes);
+        return -e;
+    }
+    seg->refs            = 1;
+    seg->procs[0].pid    = getpid();
+    seg->procs[0].refs   = 1;
+    seg->size_words      = size_words;
+    seg->page_size_bytes = page_size_bytes;
+    seg->cached          = cached;
+    seg->bytes           = bytes;
+    __atomic_store_n(&seg->ready, 1, __ATOMIC_RELEASE);
+    *shm = seg;
+    return 0; //success
+}
+
+//----------------------------------------------------------
+// shm_join
+//
+// Maps a segment created by another process once it is ready
+// and takes a reference on it.
+//----------------------------------------------------------
+// @param[in]  : fd              - existing segment
+// @param[in]  : size_words      - device size in bytes
+// @param[in]  : page_size_bytes - device page size
+// @param[in]  : cached          - nonzero if a shadow is reserved
+// @param[in]  : shm             - receives mapped segment
+// @param[out] : int             - 0 on success, -EAGAIN if it is
+//                                 being removed, -EBUSY if every
+//                                 process slot is taken
+//
+static int shm_join(int fd, uint32_t size_words, uint32_t page_size_bytes,
+    int cached, eeprom_shm_t **shm)
+{
+    struct stat st;
+    int         tries = 0;
+    while ((fstat(fd, &st) == 0) && (st.st_size < (off_t)SHM_HEADER))
+    {
+        if (++tries > SHM_WAIT_TRIES)
+        {
+            return -ETIMEDOUT;
+        }
+        shm_pause();
+    }
+    eeprom_shm_t *seg = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+    {
+        return -EIO;
+    }
+    while (!__atomic_load_n(&seg->ready, __ATOMIC_ACQUIRE))
+    {
+        if (++tries > SHM_WAIT_TRIES)
+        {
+            munmap(seg, st.st_size);
+            return -ETIMEDOUT;
+        }
+        shm_pause();
+    }
+    if ((seg->size_words != size_words) || (seg->page_size_bytes != page_size_bytes) ||
+        (seg->cached != (uint32_t)cached))
+    {
+        printf("Shared device state describes another configuration\n");
+        munmap(seg, st.st_size);
+        return -EBUSY;
+    }
+
+    if (eeprom_shm_lock(seg) < 0)
+    {
+        munmap(seg, st.st_size);
+        return -EIO;
+    }
+    int                e    = seg->unlinked ? -EAGAIN : -EBUSY;
+    eeprom_shm_proc_t *slot = seg->unlinked ? NULL : shm_proc(seg, 1);
+    if (slot != NULL)
+    {
+        slot->refs++;
+        seg->refs++;
+        e = 0;
+    }
+    pthread_mutex_unlock(&seg->mutex);
+    if (e < 0)
+    {
+        if (e == -EBUSY)
+        {
+            printf("Shared device state has too many processes attached\n");
+        }
+        munmap(seg, st.st_size);
+        return e;
+    }
+    *shm = seg;
+    return 0; //success
+}
+
+//Public specification in header
+int eeprom_shm_attach(const char *name, uint32_t size_words,
+    uint32_t page_size_bytes, int cached, eeprom_shm_t **shm)
+{
+    if ((name == NULL) || (shm == NULL) || (size_words == 0) || (page_size_bytes == 0))
+    {
+        return -EINVAL;
+    }
+    const uint64_t bytes = SHM_HEADER +
+        (cached ? eeprom_cache_storage(size_words, page_size_bytes) : 0);
+    int e;
+    do
+    {
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+        {
+            e = shm_create(fd, bytes, size_words, page_size_bytes, cached, shm);
+            close(fd);
+            if (e < 0)
+            {
+                shm_unlink(name);
+            }
+            return e;
+        }
+        if (errno != EEXIST)
+        {
+            printf("Failed to create shared device state %s\n", name);
+            return -EIO;
+        }
+
+        //already attached elsewhere; it may be removed before it opens
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+        {
+            e = (errno == ENOENT) ? -EAGAIN : -EIO;
+            continue;
+        }
+        e = shm_join(fd, size_words, page_size_bytes, cached, shm);
+        close(fd);
+    } while (e == -EAGAIN);
+    return e;
+}
+
+//Public specification in header
+int eeprom_shm_detach(const char *name, eeprom_shm_t *shm)
+{
+    if ((name == NULL) || (shm == NULL))
+    {
+        return -EINVAL;
+    }
+    if (eeprom_shm_lock(shm) < 0)
+    {
+        munmap(shm, shm->bytes);
+        return -EIO;
+    }
+    eeprom_shm_proc_t *slot = shm_proc(shm, 0);
+    if ((slot != NULL) && (--slot->refs == 0))
+    {
+        slot->pid = 0;
+    }
+    shm->refs--;
+    shm_reap(shm);
+    if (shm->refs == 0)
+    {
+        //mapping stays valid for anyone still joining, see shm_join
+        shm->unlinked = 1;
+        shm_unlink(name);
+    }
+    pthread_mutex_unlock(&shm->mutex);
+    munmap(shm, shm->bytes);
+    return 0; //success
+}
+
+//Public specification in header
+void *eeprom_shm_shadow(eeprom_shm_t *shm)
+{
+    return (char*)shm + SHM_HEADER;
+}
@@ -0,0 +1,135 @@
+/* eeprom_shm.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_shm_h
+#define _eeprom_shm_h
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "eeprom_stats.h"
+
+#define EEPROM_SHM_PROCS 32 //processes one segment can have attached
+
+//Attachments held by one process
+typedef struct eeprom_shm_proc
+{
+    //attached process, 0 for a free slot
+    pid_t pid;
+
+    //device structs it has open on the segment
+    uint32_t refs;
+
+} eeprom_shm_proc_t;
+
+//Driver state shared by every process attached to one named
+//POSIX shared memory segment: the device mutex, the runtime
+//counters and, for EEPROM_F_CACHE, the shadow image with its
+//dirty bits and sequence counts (see eeprom_cache_attach). The
+//segment is created by the first process to attach and removed
+//when the last one detaches. Processes that exit without
+//detaching are dropped the next time the mutex is found with a
+//dead owner or a live process detaches.
+typedef struct eeprom_shm
+{
+    //set once the creating process has initialized the segment
+    uint32_t ready;
+
+    //name removed by the last detach, late attachers start over
+    uint32_t unlinked;
+
+    //attached device structs, sum of procs refs, changed under mutex
+    uint32_t refs;
+
+    //attaching processes, changed under mutex
+    eeprom_shm_proc_t procs[EEPROM_SHM_PROCS];
+
+    //geometry and EEPROM_F_CACHE of every attached device
+    uint32_t size_words;
+    uint32_t page_size_bytes;
+    uint32_t cached;
+
+    //shadow filled from the device, changed under mutex
+    uint32_t warm;
+
+    //set when the mutex was taken from a dead owner and cleared
+    //once the shadow is repaired, changed under mutex
+    uint32_t recovered;
+
+    //segment size in bytes
+    uint64_t bytes;
+
+    //process shared robust device mutex, take with eeprom_shm_lock
+    pthread_mutex_t mutex;
+
+    //runtime counters of every attached device struct
+    eeprom_stats_t stats;
+
+} eeprom_shm_t;
+
+
+//----------------------------------------------------------
+// eeprom_shm_attach
+//
+// Maps the segment called name, creating and initializing it
+// when no process has it attached. Every process must describe
+// the same device: geometry and cached must match the creator's.
+//----------------------------------------------------------
+// @param[in]  : name            - segment name, leading '/'
+// @param[in]  : size_words      - device size in bytes
+// @param[in]  : page_size_bytes - device page size
+// @param[in]  : cached          - nonzero to reserve a shadow
+// @param[in]  : shm             - receives mapped segment
+// @param[out] : int             - 0 on success, -EBUSY on mismatch
+//                                 or when EEPROM_SHM_PROCS other
+//                                 processes are attached
+//
+int eeprom_shm_attach(const char *name, uint32_t size_words,
+    uint32_t page_size_bytes, int cached, eeprom_shm_t **shm);
+
+
+//----------------------------------------------------------
+// eeprom_shm_detach
+//
+// Unmaps a segment taken by eeprom_shm_attach, removing its
+// name when no other process has it attached.
+//----------------------------------------------------------
+// @param[in]  : name - segment name passed to attach
+// @param[in]  : shm  - mapped segment
+// @param[out] : int  - 0 on success
+//
+int eeprom_shm_detach(const char *name, eeprom_shm_t *shm);
+
+
+//----------------------------------------------------------
+// eeprom_shm_lock
+//
+// Takes the segment mutex. When its previous owner died holding
+// it the mutex is made consistent, every exited process's
+// attachments are dropped, so the segment can still be removed
+// by the last live detach, and recovered is set: whatever the
+// dead owner was changing under the mutex may be half done.
+//----------------------------------------------------------
+// @param[in]  : shm - mapped segment
+// @param[out] : int - 0 on success, -EIO if the mutex is unusable
+//
+int eeprom_shm_lock(eeprom_shm_t *shm);
+
+
+//----------------------------------------------------------
+// eeprom_shm_shadow
+//
+// Returns the shadow storage following the segment header,
+// eeprom_cache_storage bytes when attached with cached set.
+//----------------------------------------------------------
+// @param[in]  : shm   - mapped segment
+// @param[out] : void* - shadow storage
+//
+void *eeprom_shm_shadow(eeprom_shm_t *shm);
+
+
+#endif
@@ -0,0 +1,20 @@
+/* eeprom_stats.c
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#include "eeprom_stats.h"
+
+//Public specification in header
+void eeprom_stats_snapshot(const eeprom_stats_t *src, eeprom_stats_t *dst)
+{
+    //struct is nothing but uint64_t counters
+    const uint64_t *from = (const uint64_t*)src;
+    uint64_t       *to   = (uint64_t*)dst;
+    size_t          i;
+    for (i = 0; i < sizeof(eeprom_stats_t)/sizeof(uint64_t); i++)
+    {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
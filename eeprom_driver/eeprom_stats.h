@@ -0,0 +1,123 @@
+/* eeprom_stats.h
+ *
+ * Justin S. Selig
+ * System Tier
+ */
+
+#ifndef _eeprom_stats_h
+#define _eeprom_stats_h
+
+#include <stdint.h>
+#include <time.h>
+
+//Latency histogram buckets; bucket i counts transactions that
+//took [2^i, 2^(i+1)) ns, last bucket also holds anything slower
+#define EEPROM_LAT_BUCKETS 32
+
+//Per-device runtime counters. Updated with relaxed atomic adds
+//so no lock is taken to record; eeprom_get_stats copies them
+//out. Every field is a uint64_t counter.
+typedef struct eeprom_stats
+{
+    //completed eeprom_read/eeprom_write calls
+    uint64_t reads;
+    uint64_t writes;
+
+    //payload moved by those calls
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+
+    //page write transactions issued to the hardware tier
+    uint64_t page_programs;
+
+    //page writes skipped as unchanged, see EEPROM_F_ELIDE
+    uint64_t pages_elided;
+
+    //every hardware tier transaction, reads included
+    uint64_t device_calls;
+
+    //hardware tier transactions that returned an error
+    uint64_t device_errors;
+
+    //transactions not acknowledged during a write cycle and
+    //retried, see eeprom_device_set_timing
+    uint64_t ack_polls;
+
+    //lock free cached reads repeated after racing a writer
+    uint64_t seq_retries;
+
+    //failed transactions attempted again under dev->retry
+    uint64_t retries;
+
+    //time spent blocked acquiring and holding the device lock
+    uint64_t lock_wait_ns;
+    uint64_t lock_hold_ns;
+
+    //end to end latency of eeprom_read/eeprom_write
+    uint64_t read_latency[EEPROM_LAT_BUCKETS];
+    uint64_t write_latency[EEPROM_LAT_BUCKETS];
+
+    //latency of every hardware tier transaction attempt, ACK
+    //polling included
+    uint64_t attempt_latency[EEPROM_LAT_BUCKETS];
+
+} eeprom_stats_t;
+
+
+//----------------------------------------------------------
+// eeprom_stats_now
+//
+// Monotonic timestamp used for stats intervals.
+//----------------------------------------------------------
+// @param[out] : uint64_t - time in ns
+//
+static inline uint64_t eeprom_stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//----------------------------------------------------------
+// eeprom_stats_add
+//
+// Lock free counter increment.
+//----------------------------------------------------------
+// @param[in]  : counter - stats field
+// @param[in]  : value   - amount to add
+//
+static inline void eeprom_stats_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+//----------------------------------------------------------
+// eeprom_stats_latency
+//
+// Records one latency sample in a log2 histogram.
+//----------------------------------------------------------
+// @param[in]  : hist - EEPROM_LAT_BUCKETS counters
+// @param[in]  : ns   - sample
+//
+static inline void eeprom_stats_latency(uint64_t *hist, uint64_t ns)
+{
+    int bucket = (ns > 1) ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= EEPROM_LAT_BUCKETS)
+    {
+        bucket = EEPROM_LAT_BUCKETS - 1;
+    }
+    eeprom_stats_add(&hist[bucket], 1);
+}
+
+//----------------------------------------------------------
+// eeprom_stats_snapshot
+//
+// Copies every counter of src into dst with atomic loads.
+//----------------------------------------------------------
+// @param[in]  : src - live counters
+// @param[in]  : dst - snapshot
+//
+void eeprom_stats_snapshot(const eeprom_stats_t *src, eeprom_stats_t *dst);
+
+
+#endif
@@ -5,10 +5,25 @@
  */
 
 #include "eeprom.h"
+#include "eeprom_async.h"
+#include "eeprom_cursor.h"
+#include "eeprom_batch.h"
+#include "eeprom_sched.h"
+#include "eeprom_part.h"
+#include "device/crc32c.h"
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 //Global device mutex for any process interfacing with eeprom
 pthread_mutex_t eeprom_lock;
 
+//Global striped page lock, alternative to eeprom_lock (test 9)
+eeprom_lock_t eeprom_page_lock;
+
 //User-defined callback function for driver errors
 void generic_fault_handler(char *err)
 {
@@ -28,7 +43,7 @@ int test_1()
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -36,6 +51,10 @@ int test_1()
     dev->mutex = &eeprom_lock;
     dev->properties = props;
     dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     const uint32_t offset  = 0;
     char           wbuf[]  = {0x44, 0x44, 0x44, 0x44, 0x44}; //ascii 'D'
@@ -63,6 +82,7 @@ int test_1()
         }
     }
 
+    eeprom_close(dev);
     free(dev);
     return 1; //success
 }
@@ -78,7 +98,7 @@ int test_2()
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -86,6 +106,10 @@ int test_2()
     dev->mutex = &eeprom_lock;
     dev->properties = props;
     dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     const uint32_t offset  = 30;
     char           wbuf[]  = {0x44, 0x44, 0x44, 0x44, 0x44}; //ascii 'D'
@@ -97,6 +121,7 @@ int test_2()
     if (res < 0)
     {
         printf("test 2 failed to write to device\n");
+        eeprom_close(dev);
         free(dev);
         return -1;
     }
@@ -104,6 +129,7 @@ int test_2()
     if (res < 0)
     {
         printf("test 2 failed to read from device\n");
+        eeprom_close(dev);
         free(dev);
         return -1;
     }
@@ -111,11 +137,13 @@ int test_2()
     {
         if (wbuf[i] != rbuf[i])
         {
+            eeprom_close(dev);
             free(dev);
             return -1;
         }
     }
 
+    eeprom_close(dev);
     free(dev);
     return 1; //success
 }
@@ -131,7 +159,7 @@ int test_3()
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -139,6 +167,10 @@ int test_3()
     dev->mutex = &eeprom_lock;
     dev->properties = props;
     dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     char wbuf[100]  = {
          0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
@@ -161,6 +193,7 @@ int test_3()
     if (res < 0)
     {
         printf("test 3 failed to write to device\n");
+        eeprom_close(dev);
         free(dev);
         return -1;
     }
@@ -169,6 +202,7 @@ int test_3()
     if (res < 0)
     {
         printf("test 3 failed to read from device\n");
+        eeprom_close(dev);
         free(dev);
         return -1;
     }
@@ -176,11 +210,13 @@ int test_3()
     {
         if (wbuf[i] != rbuf[i])
         {
+            eeprom_close(dev);
             free(dev);
             return -1;
         }
     }
 
+    eeprom_close(dev);
     free(dev);
     return 1; //success
 }
@@ -196,7 +232,7 @@ int test_4()
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -204,6 +240,10 @@ int test_4()
     dev->mutex = &eeprom_lock;
     dev->properties = props;
     dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     const uint32_t offset  = 8000;
     char           wbuf[]  = {0x44}; //ascii 'D'
@@ -218,6 +258,7 @@ int test_4()
         if (res < 0)
         {
             printf("test 4 failed to write to device\n");
+            eeprom_close(dev);
             free(dev);
             return -1;
         }
@@ -235,6 +276,8 @@ int test_4()
     //     }
     // }
 
+    eeprom_close(dev);
+    free(dev);
     return 1; //success
 }
 
@@ -271,7 +314,7 @@ void * p1_write_to_eeprom(void *arg)
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -280,6 +323,10 @@ void * p1_write_to_eeprom(void *arg)
     dev->properties = props;
     dev->fault_handler = generic_fault_handler;
     dev->id = 1; //optional
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     char buf[] = {0x55, 0x55, 0x55, 0x55, 0x55}; //ascii 'U'
     int res = eeprom_write(dev, 30, sizeof(buf), buf);
@@ -292,6 +339,7 @@ void * p1_write_to_eeprom(void *arg)
         printf("p1 wrote successfully\n");
     }
 
+    eeprom_close(dev);
     free(dev);
     return 0;
 }
@@ -306,7 +354,7 @@ void * p2_write_to_eeprom(void *arg)
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -315,6 +363,10 @@ void * p2_write_to_eeprom(void *arg)
     dev->properties    = props;
     dev->fault_handler = generic_fault_handler;
     dev->id            = 2; //optional
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     char buf[] = {0x44, 0x44, 0x44, 0x44, 0x44}; //ascii 'D'
     int res = eeprom_write(dev, 30, sizeof(buf), buf);
@@ -327,6 +379,7 @@ void * p2_write_to_eeprom(void *arg)
         printf("p2 wrote successfully\n");
     }
 
+    eeprom_close(dev);
     free(dev);
     return 0;
 }
@@ -341,7 +394,7 @@ void * p3_read_from_eeprom(void *arg)
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -350,6 +403,10 @@ void * p3_read_from_eeprom(void *arg)
     dev->properties    = props;
     dev->fault_handler = generic_fault_handler;
     dev->id            = 3; //optional
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     const uint32_t offset  = 10;
     const uint32_t size    = 50;
@@ -366,6 +423,7 @@ void * p3_read_from_eeprom(void *arg)
         printf("p3 read successfully\n");
     }
 
+    eeprom_close(dev);
     free(dev);
     return 0;
 }
@@ -380,7 +438,7 @@ void * p4_read_from_eeprom(void *arg)
         .word_size_bits = 8,
         .page_size_bytes = 32,
     };
-    eeprom_dev_t *dev = malloc(sizeof(eeprom_dev_t));
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
     if (dev == NULL)
     {
         printf("failed device allocation\n");
@@ -389,6 +447,10 @@ void * p4_read_from_eeprom(void *arg)
     dev->properties    = props;
     dev->fault_handler = generic_fault_handler;
     dev->id            = 4; //optional
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
 
     const uint32_t offset  = 10;
     const uint32_t size    = 50;
@@ -405,102 +467,2515 @@ void * p4_read_from_eeprom(void *arg)
         printf("p4 read successfully\n");
     }
 
+    eeprom_close(dev);
     free(dev);
     return 0;
 }
 
-int main()
+//Tests write, read across page boundary through mapped image
+int test_7()
 {
-    int res = 0;
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->backend = EEPROM_DEVICE_MMAP;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+        free(dev);
+        return -1;
+    }
 
-    //Test simple write than read
-    printf("TEST 1: Write and Read Within Page\n");
-    res = test_1();
-    if (res == 1)
+    const uint32_t offset  = 60;
+    char           wbuf[]  = {0x4D, 0x4D, 0x4D, 0x4D, 0x4D, 0x4D}; //ascii 'M'
+    int            size    = 6;
+    int            res     = 0;
+    char           rbuf[1024];
+    int            i;
+    res = eeprom_write(dev, offset, size, wbuf);
+    if (res < 0)
     {
-        printf("test 1 succeeded\n");
+        printf("test 7 failed to write to device\n");
+        eeprom_close(dev);
+        free(dev);
+        return -1;
     }
-    else
+    res = eeprom_read(dev, offset, size, rbuf);
+    if (res < 0)
     {
-        printf("test 1 failed\n");
+        printf("test 7 failed to read from device\n");
+        eeprom_close(dev);
+        free(dev);
+        return -1;
+    }
+    for (i=0; i<size; i++)
+    {
+        if (wbuf[i] != rbuf[i])
+        {
+            eeprom_close(dev);
+            free(dev);
+            return -1;
+        }
     }
 
-    //Test write then read across page boundaries
-    printf("TEST 2: Write and Read Across Single Page Boundary\n");
-    res = 0;
-    res = test_2();
-    if (res == 1)
+    eeprom_close(dev);
+    free(dev);
+    return 1; //success
+}
+
+//Tests write-back cache absorbs writes until flushed
+int test_8()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    eeprom_dev_t *raw = calloc(1, sizeof(eeprom_dev_t));
+    if ((dev == NULL) || (raw == NULL))
     {
-        printf("test 2 succeeded\n");
+        printf("failed device allocation\n");
     }
-    else
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->flags = EEPROM_F_CACHE;
+    raw->mutex = &eeprom_lock;
+    raw->properties = props;
+    raw->fault_handler = generic_fault_handler;
+    if ((eeprom_open(dev) < 0) || (eeprom_open(raw) < 0))
     {
-        printf("test 2 failed\n");
+        printf("failed device open\n");
     }
 
-    //Test write then read across multiple page boundaries
-    printf("TEST 3: Write and Read Across Multiple Page Boundaries\n");
-    res = 0;
-    res = test_3();
-    if (res == 1)
+    const uint32_t offset  = 8000;
+    char           wbuf[]  = {0x43}; //ascii 'C'
+    int            size    = 1;
+    char           rbuf[1024];
+    int            i;
+
+    //same single byte pattern as test 4, absorbed by cache
+    for (i=offset; i < offset+192; i++)
     {
-        printf("test 3 succeeded\n");
+        eeprom_write(dev, i, size, wbuf);
     }
-    else
+    eeprom_read(dev, offset, 192, rbuf);
+    for (i=0; i<192; i++)
     {
-        printf("test 3 failed\n");
+        if (rbuf[i] != wbuf[0])
+        {
+            printf("test 8 cache read mismatch\n");
+            return -1;
+        }
+    }
+    //device itself untouched until flush
+    eeprom_read(raw, offset, 192, rbuf);
+    if (rbuf[0] == wbuf[0])
+    {
+        printf("test 8 cached write reached device before flush\n");
+        return -1;
+    }
+    if (eeprom_flush(dev) < 0)
+    {
+        printf("test 8 failed to flush\n");
+        return -1;
+    }
+    eeprom_read(raw, offset, 192, rbuf);
+    for (i=0; i<192; i++)
+    {
+        if (rbuf[i] != wbuf[0])
+        {
+            printf("test 8 flushed data mismatch\n");
+            return -1;
+        }
     }
 
-    //Test write and read outside of eeprom boundaries
-    printf("TEST 4: Write and Read at EEPROM Boundary\n");
-    res = 0;
-    res = test_4();
-    if (res == 1)
+    //a second shadow of the same image would never see dev's writes
+    eeprom_dev_t second = *raw;
+    second.flags = EEPROM_F_CACHE;
+    if (eeprom_open(&second) != -EBUSY)
     {
-        printf("test 4 succeeded\n");
+        printf("test 8 opened a second shadow of one image\n");
+        return -1;
     }
-    else
+
+    eeprom_close(raw);
+    eeprom_close(dev);
+    free(raw);
+    free(dev);
+    return 1; //success
+}
+
+//striped lock worker: even ids write own page, odd ids read
+void * p_striped_access(void *arg)
+{
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
     {
-        printf("test 4 failed\n");
+        printf("failed device allocation\n");
+        return (void*)-1;
+    }
+    dev->lock          = &eeprom_page_lock;
+    dev->properties    = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->id            = (int)(intptr_t)arg;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+        free(dev);
+        return (void*)-1;
     }
 
-    //Test bad user input
-    printf("TEST 5: Bad User Input, should fail\n");
-    res = 0;
-    res = test_5();
-    if (res == 1)
+    char buf[32];
+    int  res;
+    if ((dev->id % 2) == 0)
     {
-        printf("test 5 succeeded\n");
+        memset(buf, 0x30 + dev->id, sizeof(buf)); //ascii digit
+        res = eeprom_write(dev, 1024 + dev->id*32, sizeof(buf), buf);
     }
     else
     {
-        printf("test 5 failed\n");
+        res = eeprom_read(dev, 2048, sizeof(buf), buf);
     }
 
-    printf("TEST 6: Multiple Writers and Multiple Readers\n");
-    //initialize device mutex
-    pthread_mutexattr_t mattr;
-    pthread_mutexattr_init(&mattr);
-    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&eeprom_lock, &mattr);
-    if (pthread_mutex_init(&eeprom_lock, NULL) != 0)
+    eeprom_close(dev);
+    free(dev);
+    return (void*)(intptr_t)res;
+}
+
+//Tests concurrent readers and page-disjoint writers with striped locks
+int test_9()
+{
+    const int num_threads = 8;
+    pthread_t threads[8];
+    void     *res;
+    int       i, j;
+    if (eeprom_lock_init(&eeprom_page_lock, 16, 32) < 0)
     {
-        printf("mutex init failed\n");
+        printf("test 9 failed lock init\n");
         return -1;
     }
+    for (i=0; i<num_threads; i++)
+    {
+        pthread_create(&threads[i], NULL, &p_striped_access, (void*)(intptr_t)i);
+    }
+    for (i=0; i<num_threads; i++)
+    {
+        pthread_join(threads[i], &res);
+        if (res != 0)
+        {
+            printf("test 9 thread %i failed\n", i);
+            eeprom_lock_destroy(&eeprom_page_lock);
+            return -1;
+        }
+    }
 
-    pthread_t writer1, writer2, reader1, reader2; //thread ids
-    //two writer threads
-    pthread_create(&writer1, NULL, &p1_write_to_eeprom, NULL); //thread1
-    pthread_create(&writer2, NULL, &p2_write_to_eeprom, NULL); //thread2
-    //two reader threads
-    pthread_create(&reader1, NULL, &p3_read_from_eeprom, NULL); //thread3
-    pthread_create(&reader2, NULL, &p4_read_from_eeprom, NULL); //thread4
-    //start
-    pthread_join(writer1, NULL);
-    pthread_join(writer2, NULL);
-    pthread_join(reader1, NULL);
-    pthread_join(reader2, NULL);
+    //read back every writer's page through the same lock
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->lock = &eeprom_page_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+    char rbuf[1024];
+    eeprom_read(dev, 1024, num_threads*32, rbuf);
+    for (i=0; i<num_threads; i+=2)
+    {
+        for (j=0; j<32; j++)
+        {
+            if (rbuf[i*32+j] != 0x30 + i)
+            {
+                eeprom_close(dev);
+                free(dev);
+                eeprom_lock_destroy(&eeprom_page_lock);
+                return -1;
+            }
+        }
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    eeprom_lock_destroy(&eeprom_page_lock);
+    return 1; //success
+}
+
+//async completion callback, counts completions into ctx
+void async_done(void *ctx, int result)
+{
+    if (result == 0)
+    {
+        __atomic_fetch_add((int*)ctx, 1, __ATOMIC_RELAXED);
+    }
+}
+
+//Tests queued write, read with completion queue and callback
+int test_10()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    if ((eeprom_open(dev) < 0) || (eeprom_async_start(dev, 8) < 0))
+    {
+        printf("failed device open\n");
+        return -1;
+    }
+
+    char                wbuf[40];
+    char                rbuf[40];
+    int                 callbacks = 0;
+    int                 reaped    = 0;
+    eeprom_completion_t done[8];
+    int                 i;
+    memset(wbuf, 0x51, sizeof(wbuf)); //ascii 'Q'
+
+    //completions posted to queue, requests run in submission order
+    eeprom_submit_write(dev, 500, sizeof(wbuf), wbuf, NULL, wbuf);
+    eeprom_submit_read(dev, 500, sizeof(rbuf), rbuf, NULL, rbuf);
+    struct pollfd pfd = { .fd = eeprom_completion_fd(dev), .events = POLLIN };
+    while (reaped < 2)
+    {
+        if (poll(&pfd, 1, 1000) <= 0)
+        {
+            printf("test 10 timed out waiting for completion\n");
+            eeprom_close(dev);
+            free(dev);
+            return -1;
+        }
+        int n = eeprom_reap(dev, &done[reaped], 8 - reaped);
+        for (i=reaped; i<reaped+n; i++)
+        {
+            if (done[i].result < 0)
+            {
+                eeprom_close(dev);
+                free(dev);
+                return -1;
+            }
+        }
+        reaped += n;
+    }
+    if ((done[0].ctx != wbuf) || (done[1].ctx != rbuf) ||
+        memcmp(wbuf, rbuf, sizeof(wbuf)))
+    {
+        eeprom_close(dev);
+        free(dev);
+        return -1;
+    }
+
+    //callback completions, close drains the queue
+    eeprom_submit_write(dev, 600, sizeof(wbuf), wbuf, async_done, &callbacks);
+    eeprom_submit_read(dev, 600, sizeof(rbuf), rbuf, async_done, &callbacks);
+    eeprom_close(dev);
+    free(dev);
+    return (callbacks == 2) ? 1 : -1;
+}
+
+//Tests runtime statistics counters
+int test_11()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    char           wbuf[100];
+    char           rbuf[100];
+    eeprom_stats_t stats;
+    uint64_t       samples = 0;
+    int            i;
+    memset(wbuf, 0x53, sizeof(wbuf)); //ascii 'S'
+
+    //offset 30: 2 + 32 + 32 + 32 + 2 bytes, five page programs
+    eeprom_write(dev, 30, sizeof(wbuf), wbuf);
+    eeprom_read(dev, 30, sizeof(rbuf), rbuf);
+    if (eeprom_get_stats(dev, &stats) < 0)
+    {
+        eeprom_close(dev);
+        free(dev);
+        return -1;
+    }
+    for (i=0; i<EEPROM_LAT_BUCKETS; i++)
+    {
+        samples += stats.read_latency[i] + stats.write_latency[i];
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    if ((stats.reads != 1) || (stats.writes != 1) ||
+        (stats.bytes_read != 100) || (stats.bytes_written != 100) ||
+        (stats.page_programs != 5) || (stats.device_calls != 6) ||
+        (stats.device_errors != 0) || (samples != 2))
+    {
+        return -1;
+    }
+    return 1; //success
+}
+
+//Tests binary image conversion, format detection, raw newline data
+int test_12()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    const char *binary = "device/eeprom_test12.bin";
+    char        wbuf[] = {0x0A, 0x44, 0x0A, 0x0A, 0x44}; //'\n' is plain data
+    int         size   = 5;
+    char        rbuf[1024];
+    int         result = 1;
+
+    if (eeprom_device_convert(DEVICE_FILE_NAME, binary, 32) < 0)
+    {
+        printf("test 12 failed to convert image\n");
+        return -1;
+    }
+
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->image_path = binary;
+    if ((eeprom_open(dev) < 0) ||
+        (eeprom_device_format(dev->hw) != EEPROM_FORMAT_BINARY))
+    {
+        printf("test 12 failed to open binary image\n");
+        result = -1;
+    }
+    else
+    {
+        //converted contents match, test 1 left 'D' at offset 0
+        eeprom_read(dev, 0, 1, rbuf);
+        eeprom_write(dev, 8190 - size, size, wbuf);
+        eeprom_read(dev, 8190 - size, size, &rbuf[1]);
+        if ((rbuf[0] != 0x44) || memcmp(wbuf, &rbuf[1], size))
+        {
+            result = -1;
+        }
+        eeprom_close(dev);
+    }
+
+    free(dev);
+    remove(binary);
+    return result;
+}
+
+//per-chip writer for test 13, arg is the chip's device struct
+void * p_chip_write(void *arg)
+{
+    eeprom_dev_t *dev = arg;
+    char          buf[256];
+    memset(buf, 0x41 + dev->id, sizeof(buf)); //ascii 'A' + chip
+    return (void*)(intptr_t)eeprom_write(dev, 100, sizeof(buf), buf);
+}
+
+//Tests independent devices with their own backing images and locks
+int test_13()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    const char     *paths[2] = {"device/eeprom_chip0.bin", "device/eeprom_chip1.bin"};
+    pthread_mutex_t locks[2];
+    eeprom_dev_t    devs[2];
+    pthread_t       writers[2];
+    char            rbuf[256];
+    void           *res;
+    int             result = 1;
+    int             i, j;
+
+    memset(devs, 0, sizeof(devs));
+    for (i=0; i<2; i++)
+    {
+        pthread_mutex_init(&locks[i], NULL);
+        devs[i].mutex = &locks[i];
+        devs[i].properties = props;
+        devs[i].fault_handler = generic_fault_handler;
+        devs[i].image_path = paths[i];
+        devs[i].id = i;
+        if ((eeprom_device_convert(DEVICE_FILE_NAME, paths[i], 32) < 0) ||
+            (eeprom_open(&devs[i]) < 0))
+        {
+            printf("test 13 failed to open chip %i\n", i);
+            return -1;
+        }
+    }
+    if (devs[0].hw == devs[1].hw)
+    {
+        result = -1;
+    }
+
+    //same offset on both chips, written in parallel
+    for (i=0; i<2; i++)
+    {
+        pthread_create(&writers[i], NULL, &p_chip_write, &devs[i]);
+    }
+    for (i=0; i<2; i++)
+    {
+        pthread_join(writers[i], &res);
+        if (res != 0)
+        {
+            result = -1;
+        }
+    }
+    for (i=0; i<2; i++)
+    {
+        eeprom_read(&devs[i], 100, sizeof(rbuf), rbuf);
+        for (j=0; j<sizeof(rbuf); j++)
+        {
+            if (rbuf[j] != 0x41 + i)
+            {
+                result = -1;
+            }
+        }
+        eeprom_close(&devs[i]);
+        pthread_mutex_destroy(&locks[i]);
+        remove(paths[i]);
+    }
+    return result;
+}
+
+//Tests scatter-gather merge order, in-page gap fill, page program count
+int test_14()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    char           fill[192];
+    char           a[4], b[3], c[4], d[8], e[2];
+    char           rbuf[192];
+    char           expect[192];
+    eeprom_stats_t before;
+    eeprom_stats_t after;
+    int            result = 1;
+    memset(fill, '.', sizeof(fill));
+    memset(a, 'A', sizeof(a));
+    memset(b, 'B', sizeof(b));
+    memset(c, 'C', sizeof(c));
+    memset(d, 'D', sizeof(d));
+    memset(e, 'E', sizeof(e));
+    eeprom_write(dev, 64, sizeof(fill), fill);
+
+    //unsorted, overlapping (C over A), gap 106..109 in the same page
+    eeprom_iovec_t wv[] = {
+        { 100, sizeof(a), a },
+        { 200, sizeof(d), d },
+        {  96, sizeof(b), b },
+        { 102, sizeof(c), c },
+        { 110, sizeof(e), e },
+    };
+    eeprom_get_stats(dev, &before);
+    if (eeprom_writev(dev, wv, 5) < 0)
+    {
+        result = -1;
+    }
+    eeprom_get_stats(dev, &after);
+
+    //pages 3 and 6 only, each programmed once
+    if (after.page_programs - before.page_programs != 2)
+    {
+        result = -1;
+    }
+
+    memcpy(expect, fill, sizeof(expect));
+    memcpy(expect + 96 - 64, b, sizeof(b));
+    memcpy(expect + 100 - 64, a, sizeof(a));
+    memcpy(expect + 102 - 64, c, sizeof(c));
+    memcpy(expect + 110 - 64, e, sizeof(e));
+    memcpy(expect + 200 - 64, d, sizeof(d));
+    eeprom_iovec_t rv[] = {
+        { 128, 128, rbuf + 64 },
+        {  64,  64, rbuf },
+    };
+    if ((eeprom_readv(dev, rv, 2) < 0) || memcmp(rbuf, expect, sizeof(expect)))
+    {
+        result = -1;
+    }
+
+    //two gaps read back above, touching segments read nothing
+    if (after.device_calls - before.device_calls != 4)
+    {
+        result = -1;
+    }
+    eeprom_iovec_t tv[] = {
+        { 304, sizeof(d), d },
+        { 300, sizeof(a), a },
+    };
+    eeprom_get_stats(dev, &before);
+    eeprom_writev(dev, tv, 2);
+    eeprom_get_stats(dev, &after);
+    if (after.device_calls - before.device_calls != 1)
+    {
+        result = -1;
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    return result;
+}
+
+//Tests journal roll forward of an interrupted multi-page write
+int test_15()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    const char      *binary  = "device/eeprom_test15.bin";
+    const char      *journal = "device/eeprom_test15.bin" JOURNAL_SUFFIX;
+    char             jbuf[100];
+    char             kbuf[200];
+    char             rbuf[200];
+    eeprom_device_t *hw;
+    int              result = 1;
+    memset(jbuf, 0x4A, sizeof(jbuf)); //ascii 'J'
+    memset(kbuf, 0x4B, sizeof(kbuf)); //ascii 'K'
+
+    if (eeprom_device_convert(DEVICE_FILE_NAME, binary, 32) < 0)
+    {
+        printf("test 15 failed to convert image\n");
+        return -1;
+    }
+
+    //journal a 100 byte write, program only its first page then
+    //drop the device as a crash would
+    eeprom_device_extent_t ext = { 100, sizeof(jbuf), jbuf };
+    if ((eeprom_device_open(binary, EEPROM_DEVICE_PIO, &hw) < 0) ||
+        (eeprom_device_journal_begin(hw, &ext, 1) < 0))
+    {
+        printf("test 15 failed to journal write\n");
+        remove(binary);
+        return -1;
+    }
+    eeprom_device_write_page(hw, 100, jbuf, 28);
+    eeprom_device_close(hw);
+    if (access(journal, F_OK) < 0)
+    {
+        result = -1;
+    }
+
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->image_path = binary;
+    dev->flags = EEPROM_F_JOURNAL;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("test 15 failed to open binary image\n");
+        result = -1;
+    }
+    else
+    {
+        //open rolled the write forward
+        eeprom_read(dev, 100, sizeof(jbuf), rbuf);
+        if (memcmp(jbuf, rbuf, sizeof(jbuf)))
+        {
+            result = -1;
+        }
+        //journaled write across seven pages
+        eeprom_write(dev, 500, sizeof(kbuf), kbuf);
+        eeprom_read(dev, 500, sizeof(kbuf), rbuf);
+        if (memcmp(kbuf, rbuf, sizeof(kbuf)))
+        {
+            result = -1;
+        }
+
+        //journaled write fails on its second page and is rolled back
+        //before returning, so a later single page write inside it
+        //survives the next journaled write
+        int committed;
+        eeprom_read(dev, 300, sizeof(jbuf), rbuf + sizeof(jbuf));
+        eeprom_device_inject_fault(dev->hw, 1, 1, -EIO);
+        if ((eeprom_write_partial(dev, 300, sizeof(jbuf), kbuf, &committed) != -EIO) ||
+            (committed != 0))
+        {
+            result = -1;
+        }
+        eeprom_read(dev, 300, sizeof(jbuf), rbuf);
+        if (memcmp(rbuf, rbuf + sizeof(jbuf), sizeof(jbuf)))
+        {
+            result = -1;
+        }
+        eeprom_write(dev, 330, 4, jbuf);
+        eeprom_write(dev, 600, sizeof(jbuf), jbuf);
+        memcpy(rbuf + sizeof(jbuf) + 30, jbuf, 4);
+        eeprom_read(dev, 300, sizeof(jbuf), rbuf);
+        if (memcmp(rbuf, rbuf + sizeof(jbuf), sizeof(jbuf)))
+        {
+            result = -1;
+        }
+        eeprom_close(dev);
+    }
+
+    //retired journal is removed with the image handle
+    if (access(journal, F_OK) == 0)
+    {
+        result = -1;
+    }
+    free(dev);
+    remove(binary);
+    remove(journal);
+    return result;
+}
+
+//Tests write elision on the device and cache paths
+int test_16()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->flags = EEPROM_F_ELIDE;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    char           wbuf[100];
+    char           rbuf[100];
+    eeprom_stats_t before;
+    eeprom_stats_t after;
+    int            result = 1;
+    memset(wbuf, 0x45, sizeof(wbuf)); //ascii 'E'
+
+    //offset 30 touches five pages, rewrite with one byte changed
+    eeprom_write(dev, 30, sizeof(wbuf), wbuf);
+    wbuf[40] = 0x46; //ascii 'F', address 70
+    eeprom_get_stats(dev, &before);
+    eeprom_write(dev, 30, sizeof(wbuf), wbuf);
+    eeprom_get_stats(dev, &after);
+    eeprom_read(dev, 30, sizeof(rbuf), rbuf);
+    if ((after.page_programs - before.page_programs != 1) ||
+        (after.pages_elided - before.pages_elided != 4) ||
+        memcmp(wbuf, rbuf, sizeof(wbuf)))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    //cached: identical rewrite leaves every page clean
+    dev->flags = EEPROM_F_CACHE | EEPROM_F_ELIDE;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+    eeprom_get_stats(dev, &before);
+    eeprom_write(dev, 30, sizeof(wbuf), wbuf);
+    eeprom_flush(dev);
+    eeprom_get_stats(dev, &after);
+    if ((after.page_programs != before.page_programs) ||
+        (after.pages_elided - before.pages_elided != 5))
+    {
+        result = -1;
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    return result;
+}
+
+//Tests bus timing model, ACK polling and elided wall clock savings
+int test_17()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_device_timing_t timing = {
+        .clock_hz = 400000,
+        .write_cycle_us = 2000,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->timing = timing;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    char           wbuf[100];
+    char           rbuf[100];
+    eeprom_stats_t stats;
+    uint64_t       full;
+    uint64_t       elided;
+    uint64_t       start;
+    int            result = 1;
+    memset(wbuf, 0x54, sizeof(wbuf)); //ascii 'T'
+
+    //five page writes, each after the first waits out tWR
+    start = eeprom_stats_now();
+    eeprom_write(dev, 30, sizeof(wbuf), wbuf);
+    full = eeprom_stats_now() - start;
+    eeprom_read(dev, 30, sizeof(rbuf), rbuf);
+    eeprom_get_stats(dev, &stats);
+    if ((full < 4 * 2000000ull) || (stats.ack_polls == 0) ||
+        memcmp(wbuf, rbuf, sizeof(wbuf)))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    //identical rewrite costs one sequential read and no tWR
+    dev->flags = EEPROM_F_ELIDE;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+    start = eeprom_stats_now();
+    eeprom_write(dev, 30, sizeof(wbuf), wbuf);
+    elided = eeprom_stats_now() - start;
+    eeprom_get_stats(dev, &stats);
+    if ((stats.page_programs != 0) || (elided * 2 > full))
+    {
+        result = -1;
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    return result;
+}
+
+//Tests cursor scan against a plain read, with and without read-ahead
+int test_18()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    const int        words = props.device_size_words;
+    char            *image = malloc(words);
+    char            *scan  = malloc(words);
+    char             chunk[100];
+    eeprom_cursor_t *cursor;
+    eeprom_stats_t   before;
+    eeprom_stats_t   after;
+    int              result = 1;
+    int              pass;
+    eeprom_read(dev, 0, words, image);
+
+    //pass 0 prefetches on the cursor's own reader thread, pass 1
+    //through the device's asynchronous queue
+    for (pass = 0; pass < 2; pass++)
+    {
+        int done = 0;
+        int n;
+        if ((pass == 1) && (eeprom_async_start(dev, 4) < 0))
+        {
+            result = -1;
+            break;
+        }
+        eeprom_get_stats(dev, &before);
+        if (eeprom_cursor_open(dev, 0, words, 256, &cursor) < 0)
+        {
+            result = -1;
+            break;
+        }
+        //first window fills before it is asked for
+        int ready = 0;
+        for (n = 0; (n < 1000) && !ready; n++)
+        {
+            pthread_mutex_lock(&cursor->lock);
+            ready = (cursor->buf[1].state == EEPROM_CURSOR_READY);
+            pthread_mutex_unlock(&cursor->lock);
+            if (!ready)
+            {
+                usleep(1000);
+            }
+        }
+        if (!ready)
+        {
+            result = -1;
+        }
+        while ((n = eeprom_cursor_next(cursor, chunk, sizeof(chunk))) > 0)
+        {
+            memcpy(scan + done, chunk, n);
+            done += n;
+        }
+        eeprom_cursor_close(cursor);
+        eeprom_get_stats(dev, &after);
+
+        //one sequential read per 256 byte window
+        if ((n < 0) || (done != words) || memcmp(image, scan, words) ||
+            (after.reads - before.reads != words / 256))
+        {
+            result = -1;
+        }
+    }
+
+    free(image);
+    free(scan);
+    eeprom_close(dev);
+    free(dev);
+    return result;
+}
+
+//shared by test 19 threads
+static eeprom_dev_t *seq_dev;
+static volatile int  seq_stop;
+
+//test 19 writer, alternates two whole patterns across pages
+void * p_seq_writer(void *arg)
+{
+    char buf[4096];
+    int  i;
+    for (i = 0; i < 5000; i++)
+    {
+        memset(buf, (i & 1) ? 0x58 : 0x59, sizeof(buf)); //ascii 'X'/'Y'
+        eeprom_write(seq_dev, 30, sizeof(buf), buf);
+    }
+    seq_stop = 1;
+    return NULL;
+}
+
+//test 19 reader, returns number of torn reads seen
+void * p_seq_reader(void *arg)
+{
+    char      buf[4096];
+    intptr_t  torn = 0;
+    int       i;
+    while (!seq_stop)
+    {
+        eeprom_read(seq_dev, 30, sizeof(buf), buf);
+        for (i = 1; i < sizeof(buf); i++)
+        {
+            if (buf[i] != buf[0])
+            {
+                torn++;
+                break;
+            }
+        }
+    }
+    return (void*)torn;
+}
+
+//Tests lock free cached reads never observe a partial write
+int test_19()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->flags = EEPROM_F_CACHE;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    char      buf[4096];
+    pthread_t writer;
+    pthread_t readers[2];
+    void     *torn;
+    int       result = 1;
+    int       i;
+    memset(buf, 0x59, sizeof(buf));
+    eeprom_write(dev, 30, sizeof(buf), buf);
+
+    seq_dev  = dev;
+    seq_stop = 0;
+    for (i = 0; i < 2; i++)
+    {
+        pthread_create(&readers[i], NULL, p_seq_reader, NULL);
+    }
+    pthread_create(&writer, NULL, p_seq_writer, NULL);
+    pthread_join(writer, NULL);
+    for (i = 0; i < 2; i++)
+    {
+        pthread_join(readers[i], &torn);
+        if (torn != NULL)
+        {
+            result = -1;
+        }
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    return result;
+}
+
+//Tests batch coalescing, last writer wins and single commit
+int test_20()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    eeprom_batch_t *batch;
+    eeprom_stats_t  before;
+    eeprom_stats_t  after;
+    char            buf[40];
+    char            expect[20];
+    char            rbuf[40];
+    int             result = 1;
+
+    //fields saved out of order, reusing one buffer
+    eeprom_get_stats(dev, &before);
+    if (eeprom_batch_begin(dev, &batch) < 0)
+    {
+        eeprom_close(dev);
+        free(dev);
+        return -1;
+    }
+    memset(buf, 0x44, 40); //ascii 'D'
+    eeprom_batch_write(batch, 1000, 40, buf);
+    memset(buf, 0x41, 10); //ascii 'A'
+    eeprom_batch_write(batch, 300, 10, buf);
+    memset(buf, 0x42, 10); //ascii 'B'
+    eeprom_batch_write(batch, 310, 10, buf);
+    memset(buf, 0x43, 3);  //ascii 'C', overrides part of 'A'
+    eeprom_batch_write(batch, 305, 3, buf);
+    if (eeprom_batch_commit(batch) < 0)
+    {
+        result = -1;
+    }
+    eeprom_get_stats(dev, &after);
+
+    //page 9, then pages 31 and 32: one commit, three programs
+    if ((after.writes - before.writes != 1) ||
+        (after.page_programs - before.page_programs != 3))
+    {
+        result = -1;
+    }
+    memset(expect, 0x41, 10);
+    memset(expect + 5, 0x43, 3);
+    memset(expect + 10, 0x42, 10);
+    eeprom_read(dev, 300, 20, rbuf);
+    if (memcmp(expect, rbuf, 20))
+    {
+        result = -1;
+    }
+    memset(buf, 0x44, 40);
+    eeprom_read(dev, 1000, 40, rbuf);
+    if (memcmp(buf, rbuf, 40))
+    {
+        result = -1;
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    return result;
+}
+
+//Shared write scheduler for test 21
+eeprom_sched_t eeprom_write_sched;
+
+//test 21 writer, arg is its id; returns number of failed writes
+void * p_sched_write(void *arg)
+{
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->sched = &eeprom_write_sched;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->id = (int)(intptr_t)arg;
+    dev->properties.base_address = (dev->id < 2) ? 0 : 1000; //two views share one queue
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    char     buf[5];
+    intptr_t failed = 0;
+    int      i;
+    memset(buf, 0x61 + dev->id, sizeof(buf)); //ascii 'a' + id
+    for (i = 0; i < 50; i++)
+    {
+        if (eeprom_write(dev, 30, sizeof(buf), buf) < 0)
+        {
+            failed++;
+        }
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    return (void*)failed;
+}
+
+//scheduler commit that only counts, see p_sched_view
+int count_commit(eeprom_dev_t *dev, const eeprom_iovec_t *iov, int iovcnt)
+{
+    return 0;
+}
+
+//queues one write through an unopened view based at arg
+void * p_sched_view(void *arg)
+{
+    eeprom_dev_t dev;
+    char         byte = 0x76; //ascii 'v'
+    memset(&dev, 0, sizeof(dev));
+    dev.properties.base_address = (uint32_t)(intptr_t)arg;
+    dev.properties.device_size_words = 8192;
+    dev.fault_handler = generic_fault_handler;
+    eeprom_sched_write(&eeprom_write_sched, &dev, 0, 1, &byte, count_commit);
+    return NULL;
+}
+
+//Tests contending writers through the coalescing scheduler
+int test_21()
+{
+    pthread_t writers[4];
+    void     *failed;
+    char      rbuf[5];
+    int       result = 1;
+    intptr_t  i;
+
+    if (eeprom_sched_init(&eeprom_write_sched) < 0)
+    {
+        return -1;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        pthread_create(&writers[i], NULL, p_sched_write, (void*)i);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        pthread_join(writers[i], &failed);
+        if (failed != NULL)
+        {
+            result = -1;
+        }
+    }
+
+    //every request committed, last group left one writer's bytes
+    if ((eeprom_write_sched.requests != 200) ||
+        (eeprom_write_sched.batches > eeprom_write_sched.requests))
+    {
+        result = -1;
+    }
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+    //each writer's offset resolved against its own base address
+    eeprom_read(dev, 30, sizeof(rbuf), rbuf);
+    for (i = 1; i < sizeof(rbuf); i++)
+    {
+        if ((rbuf[i] != rbuf[0]) || (rbuf[0] < 0x61) || (rbuf[0] > 0x62))
+        {
+            result = -1;
+        }
+    }
+    eeprom_read(dev, 1030, sizeof(rbuf), rbuf);
+    for (i = 1; i < sizeof(rbuf); i++)
+    {
+        if ((rbuf[i] != rbuf[0]) || (rbuf[0] < 0x63) || (rbuf[0] > 0x64))
+        {
+            result = -1;
+        }
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    eeprom_sched_destroy(&eeprom_write_sched);
+
+    //views with different base addresses never share a group
+    pthread_t           views[2];
+    eeprom_sched_req_t *r;
+    int                 queued = 0;
+    eeprom_sched_init(&eeprom_write_sched);
+    eeprom_write_sched.combining = 1; //hold both requests queued
+    pthread_create(&views[0], NULL, p_sched_view, (void*)0);
+    pthread_create(&views[1], NULL, p_sched_view, (void*)1000);
+    while (queued < 2)
+    {
+        usleep(1000);
+        pthread_mutex_lock(&eeprom_write_sched.lock);
+        for (queued = 0, r = eeprom_write_sched.head; r != NULL; r = r->next)
+        {
+            queued++;
+        }
+        pthread_mutex_unlock(&eeprom_write_sched.lock);
+    }
+    pthread_mutex_lock(&eeprom_write_sched.lock);
+    eeprom_write_sched.combining = 0;
+    pthread_cond_broadcast(&eeprom_write_sched.done);
+    pthread_mutex_unlock(&eeprom_write_sched.lock);
+    pthread_join(views[0], NULL);
+    pthread_join(views[1], NULL);
+    if (eeprom_write_sched.batches != 2)
+    {
+        result = -1;
+    }
+    eeprom_sched_destroy(&eeprom_write_sched);
+    return result;
+}
+
+//corrupts one byte of a closed or open binary image behind the driver
+static void corrupt_image(const char *path, uint32_t addr)
+{
+    char bad = 0x7F;
+    int  fd  = open(path, O_WRONLY);
+    if (fd >= 0)
+    {
+        pwrite(fd, &bad, 1, EEPROM_IMAGE_HEADER + addr);
+        close(fd);
+    }
+}
+
+//Tests crc32c check value, page checksum upkeep and verification
+int test_22()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    const char *binary = "device/eeprom_test22.bin";
+    const char *table  = "device/eeprom_test22.bin" CRC_SUFFIX;
+    char        wbuf[100];
+    int         result = 1;
+    memset(wbuf, 0x43, sizeof(wbuf)); //ascii 'C'
+
+    //both implementations give the standard check value
+    if ((crc32c(0, "123456789", 9) != 0xE3069283) ||
+        (crc32c_portable(0, "123456789", 9) != 0xE3069283))
+    {
+        result = -1;
+    }
+
+    remove(table);
+    if (eeprom_device_convert(DEVICE_FILE_NAME, binary, 32) < 0)
+    {
+        printf("test 22 failed to convert image\n");
+        return -1;
+    }
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->image_path = binary;
+    dev->flags = EEPROM_F_CRC;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("test 22 failed to open binary image\n");
+        remove(binary);
+        return -1;
+    }
+
+    //checksums follow page programs, including partial pages
+    eeprom_write(dev, 40, sizeof(wbuf), wbuf);
+    if (eeprom_verify(dev, 0, 8192) != 0)
+    {
+        result = -1;
+    }
+
+    //a byte changed behind the driver fails only its own page
+    corrupt_image(binary, 70);
+    if ((eeprom_verify(dev, 0, 8192) != 1) ||
+        (eeprom_verify(dev, 68, 4) != 1) ||
+        (eeprom_verify(dev, 0, 64) != 0))
+    {
+        result = -1;
+    }
+    eeprom_write(dev, 70, 1, wbuf);
+    if (eeprom_verify(dev, 0, 8192) != 0)
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    //table saved on close catches a change made while closed
+    corrupt_image(binary, 200);
+    if ((access(table, F_OK) < 0) || (eeprom_open(dev) < 0))
+    {
+        result = -1;
+    }
+    else
+    {
+        if (eeprom_verify(dev, 0, 8192) != 1)
+        {
+            result = -1;
+        }
+        eeprom_close(dev);
+    }
+    free(dev);
+    remove(binary);
+    remove(table);
+    return result;
+}
+
+//Tests in place views of the shadow and of a mapped binary image
+int test_23()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    const char  *binary = "device/eeprom_test23.bin";
+    char         wbuf[64];
+    eeprom_map_t map;
+    int          result = 1;
+    memset(wbuf, 0x4D, sizeof(wbuf)); //ascii 'M'
+
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+
+    //plain positioned i/o keeps nothing to point into
+    if ((eeprom_open(dev) < 0) ||
+        (eeprom_map_ro(dev, 300, sizeof(wbuf), &map) != -ENOTSUP))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    //shadow view sees later writes in place, other pages do not
+    //disturb it
+    dev->flags = EEPROM_F_CACHE;
+    if ((eeprom_open(dev) < 0) ||
+        (eeprom_write(dev, 300, sizeof(wbuf), wbuf) < 0) ||
+        (eeprom_map_ro(dev, 300, sizeof(wbuf), &map) < 0))
+    {
+        printf("test 23 failed to map shadow\n");
+        free(dev);
+        return -1;
+    }
+    if (memcmp(map.data, wbuf, sizeof(wbuf)) || eeprom_map_changed(dev, &map))
+    {
+        result = -1;
+    }
+    eeprom_write(dev, 2000, 1, wbuf);
+    if (eeprom_map_changed(dev, &map))
+    {
+        result = -1;
+    }
+    wbuf[10] = 0x4E; //ascii 'N', address 310
+    eeprom_write(dev, 310, 1, wbuf + 10);
+    if (!eeprom_map_changed(dev, &map) || (map.data[10] != 0x4E))
+    {
+        result = -1;
+    }
+    if (eeprom_close(dev) != -EBUSY)
+    {
+        result = -1;
+    }
+    eeprom_unmap(dev, &map);
+    eeprom_close(dev);
+
+    //mapped binary image without a cache
+    if (eeprom_device_convert(DEVICE_FILE_NAME, binary, 32) < 0)
+    {
+        printf("test 23 failed to convert image\n");
+        free(dev);
+        return -1;
+    }
+    dev->flags = 0;
+    dev->image_path = binary;
+    dev->backend = EEPROM_DEVICE_MMAP;
+    if ((eeprom_open(dev) < 0) ||
+        (eeprom_map_ro(dev, 300, sizeof(wbuf), &map) < 0))
+    {
+        printf("test 23 failed to map image\n");
+        result = -1;
+    }
+    else
+    {
+        if (memcmp(map.data, wbuf, sizeof(wbuf)) || eeprom_map_changed(dev, &map))
+        {
+            result = -1;
+        }
+        eeprom_write(dev, 320, 1, wbuf);
+        if (!eeprom_map_changed(dev, &map) || (map.data[20] != 0x4D))
+        {
+            result = -1;
+        }
+        eeprom_unmap(dev, &map);
+        eeprom_close(dev);
+    }
+    free(dev);
+    remove(binary);
+    return result;
+}
+
+//Tests transient failures retried, deadline and partial commit
+int test_24()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+    dev->retry.attempts = 3;
+    dev->retry.backoff_us = 100;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+
+    char           wbuf[100];
+    char           xbuf[100];
+    char           rbuf[100];
+    eeprom_stats_t stats;
+    int            committed;
+    int            result = 1;
+    int            i;
+    memset(wbuf, 0x52, sizeof(wbuf)); //ascii 'R'
+    memset(xbuf, 0x53, sizeof(xbuf)); //ascii 'S'
+
+    //two transient failures absorbed by the third attempt
+    eeprom_device_inject_fault(dev->hw, 0, 2, -EIO);
+    if (eeprom_write(dev, 40, sizeof(wbuf), wbuf) < 0)
+    {
+        result = -1;
+    }
+    eeprom_device_inject_fault(dev->hw, 0, 1, -EIO);
+    eeprom_read(dev, 40, sizeof(rbuf), rbuf);
+    eeprom_get_stats(dev, &stats);
+    if (memcmp(wbuf, rbuf, sizeof(rbuf)) || (stats.retries != 3))
+    {
+        result = -1;
+    }
+
+    //third of four pages fails every attempt, first two stay
+    eeprom_device_inject_fault(dev->hw, 2, 10, -EIO);
+    if ((eeprom_write_partial(dev, 40, sizeof(xbuf), xbuf, &committed) != -EIO) ||
+        (committed != 56))
+    {
+        result = -1;
+    }
+    eeprom_device_inject_fault(dev->hw, 0, 0, -EIO);
+    eeprom_read(dev, 40, sizeof(rbuf), rbuf);
+    if (memcmp(xbuf, rbuf, committed) ||
+        memcmp(wbuf + committed, rbuf + committed, sizeof(rbuf) - committed))
+    {
+        result = -1;
+    }
+
+    //an untimed part is never busy, so an unacknowledged write is
+    //a failed attempt and retried rather than polled
+    eeprom_get_stats(dev, &stats);
+    uint64_t polls   = stats.ack_polls;
+    uint64_t retries = stats.retries;
+    eeprom_device_inject_fault(dev->hw, 0, 2, -EAGAIN);
+    if (eeprom_write_partial(dev, 40, sizeof(wbuf), wbuf, &committed) < 0)
+    {
+        result = -1;
+    }
+    eeprom_get_stats(dev, &stats);
+    if ((stats.retries - retries != 2) || (stats.ack_polls != polls))
+    {
+        result = -1;
+    }
+    eeprom_device_inject_fault(dev->hw, 0, 3, -EAGAIN);
+    if (eeprom_write_partial(dev, 40, sizeof(wbuf), wbuf, &committed) != -ETIMEDOUT)
+    {
+        result = -1;
+    }
+    eeprom_device_inject_fault(dev->hw, 0, 0, -EIO);
+
+    //doubling backoff of 1, 2, 4 ms runs into a 5 ms deadline
+    dev->retry.attempts = 100;
+    dev->retry.backoff_us = 1000;
+    dev->retry.deadline_us = 5000;
+    eeprom_get_stats(dev, &stats);
+    retries = stats.retries;
+    eeprom_device_inject_fault(dev->hw, 0, 100, -EIO);
+    if (eeprom_write_partial(dev, 0, 1, xbuf, &committed) != -EIO)
+    {
+        result = -1;
+    }
+    eeprom_device_inject_fault(dev->hw, 0, 0, -EIO);
+    eeprom_get_stats(dev, &stats);
+    if ((stats.retries - retries == 0) || (stats.retries - retries > 3))
+    {
+        result = -1;
+    }
+
+    //every attempt timed, successful or not
+    uint64_t attempts = 0;
+    for (i = 0; i < EEPROM_LAT_BUCKETS; i++)
+    {
+        attempts += stats.attempt_latency[i];
+    }
+    if (attempts != stats.device_calls)
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    //cache flush page writes retry like direct ones
+    dev->flags = EEPROM_F_CACHE;
+    dev->retry.attempts = 3;
+    dev->retry.backoff_us = 100;
+    dev->retry.deadline_us = 0;
+    if (eeprom_open(dev) < 0)
+    {
+        printf("failed device open\n");
+    }
+    eeprom_write(dev, 200, sizeof(wbuf), wbuf);
+    eeprom_device_inject_fault(dev->hw, 0, 2, -EIO);
+    eeprom_get_stats(dev, &stats);
+    retries = stats.retries;
+    if (eeprom_flush(dev) < 0)
+    {
+        result = -1;
+    }
+    eeprom_get_stats(dev, &stats);
+    if ((stats.retries - retries != 2) || (stats.page_programs != 4))
+    {
+        result = -1;
+    }
+
+    eeprom_close(dev);
+    free(dev);
+    return result;
+}
+
+//Tests shadow, lock and counters shared with a forked process
+int test_25()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    const char   *name = "/eeprom_test25";
+    char          wbuf[64];
+    char          rbuf[64];
+    eeprom_dev_t  parent = {0};
+    eeprom_dev_t  other  = {0};
+    int           status;
+    int           result = 1;
+    memset(wbuf, 0x50, sizeof(wbuf)); //ascii 'P'
+
+    parent.properties = props;
+    parent.fault_handler = generic_fault_handler;
+    parent.shm_name = name;
+    parent.flags = EEPROM_F_CACHE;
+    if (eeprom_open(&parent) < 0)
+    {
+        printf("test 25 failed to attach shared state\n");
+        return -1;
+    }
+
+    //every attached process must agree on the configuration
+    other = parent;
+    other.flags = 0;
+    if (eeprom_open(&other) != -EBUSY)
+    {
+        result = -1;
+    }
+    //checksums and the journal cannot be shared
+    other.flags = EEPROM_F_CACHE | EEPROM_F_CRC;
+    if (eeprom_open(&other) != -EINVAL)
+    {
+        result = -1;
+    }
+
+    //child attaches on its own and writes into the shared shadow
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        eeprom_dev_t child = {0};
+        child.properties = props;
+        child.fault_handler = generic_fault_handler;
+        child.shm_name = name;
+        child.flags = EEPROM_F_CACHE;
+        if ((eeprom_open(&child) < 0) ||
+            (eeprom_write(&child, 1000, sizeof(wbuf), wbuf) < 0) ||
+            (eeprom_close(&child) < 0))
+        {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid) ||
+        !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+    {
+        result = -1;
+    }
+
+    //parent's cache was warm before the write and sees it anyway
+    eeprom_stats_t stats;
+    eeprom_read(&parent, 1000, sizeof(rbuf), rbuf);
+    eeprom_get_stats(&parent, &stats);
+    if (memcmp(wbuf, rbuf, sizeof(rbuf)) || (stats.writes != 1) || (stats.reads != 1))
+    {
+        result = -1;
+    }
+
+    //child dies holding the device mutex halfway through a store
+    //into the shared shadow, its page's sequence count left odd
+    eeprom_flush(&parent);
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        eeprom_dev_t child = {0};
+        child.properties = props;
+        child.fault_handler = generic_fault_handler;
+        child.shm_name = name;
+        child.flags = EEPROM_F_CACHE;
+        if (eeprom_open(&child) < 0)
+        {
+            _exit(1);
+        }
+        pthread_mutex_lock(&child.shm->mutex);
+        __atomic_fetch_add(&child.cache->seq[1024/32], 1, __ATOMIC_RELEASE);
+        memset(child.cache->image + 1024, 0x58, 16); //ascii 'X'
+        _exit(0);
+    }
+    if ((pid < 0) || (waitpid(pid, &status, 0) != pid) ||
+        !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+    {
+        result = -1;
+    }
+
+    //lock free readers give up on the held page and lock, which
+    //recovers the mutex, drops the child's ref and rereads the page
+    eeprom_map_t map;
+    if ((eeprom_map_ro(&parent, 1000, sizeof(rbuf), &map) < 0) ||
+        memcmp(wbuf, map.data, sizeof(rbuf)) || (parent.shm->refs != 1))
+    {
+        result = -1;
+    }
+    else
+    {
+        eeprom_unmap(&parent, &map);
+    }
+    if ((eeprom_read(&parent, 1000, sizeof(rbuf), rbuf) < 0) ||
+        memcmp(wbuf, rbuf, sizeof(rbuf)) ||
+        (eeprom_write(&parent, 1000, sizeof(wbuf), wbuf) < 0))
+    {
+        result = -1;
+    }
+    eeprom_close(&parent);
+
+    //last detach removes the segment
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd >= 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        result = -1;
+    }
+    return result;
+}
+
+//Tests one workload against every backend of the ops table
+int test_26()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    const eeprom_device_backend_t backends[] = {
+        EEPROM_DEVICE_PIO, EEPROM_DEVICE_MMAP, EEPROM_DEVICE_TIMED, EEPROM_DEVICE_RAM };
+    const char *names[] = { "binary", "mmap", "binary", "ram" };
+    const char *binary  = "device/eeprom_test26.bin";
+    char        wbuf[100];
+    char        rbuf[100];
+    int         result = 1;
+    int         b;
+
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->fault_handler = generic_fault_handler;
+
+    //default image is served by the legacy text backend
+    if ((eeprom_open(dev) < 0) ||
+        strcmp(eeprom_device_backend_name(dev->hw), "legacy"))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    if (eeprom_device_convert(DEVICE_FILE_NAME, binary, 32) < 0)
+    {
+        printf("test 26 failed to convert image\n");
+        free(dev);
+        return -1;
+    }
+    dev->image_path = binary;
+    for (b = 0; b < sizeof(backends)/sizeof(backends[0]); b++)
+    {
+        eeprom_stats_t stats;
+        memset(wbuf, 0x30 + b, sizeof(wbuf)); //ascii '0' onwards
+        dev->backend = backends[b];
+        if (eeprom_open(dev) < 0)
+        {
+            result = -1;
+            continue;
+        }
+        eeprom_write(dev, 40, sizeof(wbuf), wbuf);
+        eeprom_read(dev, 40, sizeof(rbuf), rbuf);
+        eeprom_get_stats(dev, &stats);
+        if (memcmp(wbuf, rbuf, sizeof(rbuf)) || (eeprom_sync(dev) < 0) ||
+            strcmp(eeprom_device_backend_name(dev->hw), names[b]))
+        {
+            result = -1;
+        }
+        //simulated write cycle holds off the next page write
+        if ((backends[b] == EEPROM_DEVICE_TIMED) && (stats.ack_polls == 0))
+        {
+            result = -1;
+        }
+        eeprom_close(dev);
+    }
+
+    //RAM writes never reached the file, the timed ones did
+    dev->backend = EEPROM_DEVICE_PIO;
+    memset(wbuf, 0x32, sizeof(wbuf)); //ascii '2'
+    if (eeprom_open(dev) < 0)
+    {
+        result = -1;
+    }
+    else
+    {
+        eeprom_read(dev, 40, sizeof(rbuf), rbuf);
+        if (memcmp(wbuf, rbuf, sizeof(rbuf)))
+        {
+            result = -1;
+        }
+        eeprom_close(dev);
+    }
+    free(dev);
+    remove(binary);
+    return result;
+}
+
+int test_27()
+{
+    //Device initializations
+    eeprom_dev_properties_t props = {
+        .base_address = 0,
+        .device_size_bits = 65536,
+        .device_size_words = 8192,
+        .word_size_bits = 8,
+        .page_size_bytes = 32,
+    };
+    eeprom_dev_properties_t part;
+    eeprom_device_timing_t  timing;
+    eeprom_geom_t           geom;
+    const uint32_t          sizes[] = { 32, 24 };
+    int                     result = 1;
+    int                     i;
+    uint32_t                addr;
+
+    //table matches the properties every other test spells out
+    if ((eeprom_part_lookup("24c64", &part, &timing) < 0) ||
+        (part.device_size_words != props.device_size_words) ||
+        (part.device_size_bits != props.device_size_bits) ||
+        (part.page_size_bytes != props.page_size_bytes) || (timing.write_cycle_us == 0) ||
+        (part.block_size_words != 0) ||
+        (eeprom_part_lookup("24C65", &part, NULL) != -ENOENT))
+    {
+        result = -1;
+    }
+
+    //device address bits pick the 24C16's 256 byte blocks of one chip
+    if ((eeprom_part_lookup("24C16", &part, NULL) < 0) ||
+        (part.block_size_words != 256) || (part.bank_size_words != 0))
+    {
+        result = -1;
+    }
+
+    //shift and mask agree with division for either kind of page
+    for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    {
+        if (eeprom_geom_init(&geom, sizes[i]) < 0)
+        {
+#ifndef EEPROM_PAGE_SHIFT
+            result = -1;
+#endif
+            continue;
+        }
+        for (addr = 0; addr < 8192; addr++)
+        {
+            if ((eeprom_geom_page(&geom, addr) != addr / sizes[i]) ||
+                (eeprom_geom_offset(&geom, addr) != addr % sizes[i]) ||
+                (eeprom_geom_start(&geom, addr / sizes[i]) != addr - addr % sizes[i]))
+            {
+                result = -1;
+                break;
+            }
+        }
+    }
+
+#ifndef EEPROM_PAGE_SHIFT
+    char wbuf[100];
+    char rbuf[100];
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->properties = props;
+    dev->properties.page_size_bytes = 24; //unusual part, generic path
+    dev->fault_handler = generic_fault_handler;
+
+    //1000 sits 16 bytes into its page: 8 + 3*24 + 20 bytes
+    memset(wbuf, 0x36, sizeof(wbuf)); //ascii '6'
+    if (eeprom_open(dev) < 0)
+    {
+        free(dev);
+        return -1;
+    }
+    eeprom_stats_t stats;
+    eeprom_write(dev, 1000, sizeof(wbuf), wbuf);
+    eeprom_read(dev, 1000, sizeof(rbuf), rbuf);
+    eeprom_get_stats(dev, &stats);
+    if (memcmp(wbuf, rbuf, sizeof(rbuf)) || (stats.page_programs != 5))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+    free(dev);
+#endif
+    return result;
+}
+
+int test_28()
+{
+#if defined(EEPROM_PAGE_SHIFT) && (EEPROM_PAGE_SHIFT != 8)
+    return 1; //24CM02 pages are 256 bytes, this build opens no other size
+#else
+    const char *legacy = "device/eeprom_test28.dat";
+    const char *binary = "device/eeprom_test28.bin";
+    const uint32_t bank = 65536;
+    eeprom_device_timing_t timing = {
+        .clock_hz = 1000000,
+        .write_cycle_us = 20000,
+    };
+    char           wbuf[1024];
+    char           rbuf[1024];
+    eeprom_stats_t before;
+    eeprom_stats_t after;
+    uint64_t       within;
+    uint64_t       across;
+    uint64_t       start;
+    int            result = 1;
+    uint32_t       i;
+
+    //blank 256 KB image, four 64 KB blocks
+    FILE *f = fopen(legacy, "w");
+    if (f == NULL)
+    {
+        printf("test 28 failed to create image\n");
+        return -1;
+    }
+    for (i = 0; i < 4 * bank; i++)
+    {
+        fputs("0\n", f);
+    }
+    fclose(f);
+    if (eeprom_device_convert(legacy, binary, 256) < 0)
+    {
+        printf("test 28 failed to convert image\n");
+        remove(legacy);
+        return -1;
+    }
+    remove(legacy);
+
+    eeprom_dev_t *dev = calloc(1, sizeof(eeprom_dev_t));
+    if (dev == NULL)
+    {
+        printf("failed device allocation\n");
+    }
+    dev->mutex = &eeprom_lock;
+    dev->fault_handler = generic_fault_handler;
+    dev->image_path = binary;
+    if ((eeprom_part_lookup("24CM02", &dev->properties, NULL) < 0) ||
+        (dev->properties.device_size_words != 4 * bank) ||
+        (dev->properties.block_size_words != bank) ||
+        (dev->properties.bank_size_words != 0))
+    {
+        free(dev);
+        remove(binary);
+        return -1;
+    }
+
+    //blocks must hold whole pages
+    dev->properties.block_size_words = bank + 128;
+    if (eeprom_open(dev) != -EINVAL)
+    {
+        result = -1;
+    }
+    dev->properties.block_size_words = bank;
+
+    //addresses past 64 KB, and a read split at a block boundary
+    for (i = 0; i < sizeof(wbuf); i++)
+    {
+        wbuf[i] = (char)(i * 7);
+    }
+    if (eeprom_open(dev) < 0)
+    {
+        free(dev);
+        remove(binary);
+        return -1;
+    }
+    eeprom_write(dev, 3 * bank - 300, sizeof(wbuf), wbuf);
+    eeprom_get_stats(dev, &before);
+    eeprom_read(dev, 3 * bank - 300, sizeof(rbuf), rbuf);
+    eeprom_get_stats(dev, &after);
+    if (memcmp(wbuf, rbuf, sizeof(rbuf)) || (after.device_calls - before.device_calls != 2))
+    {
+        result = -1;
+    }
+    eeprom_write(dev, 4 * bank - 100, 100, wbuf);
+    eeprom_read(dev, 4 * bank - 100, 100, rbuf);
+    if (memcmp(wbuf, rbuf, 100))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    //four page writes in one chip each wait out the previous tWR,
+    //whether or not they cross a block
+    dev->timing = timing;
+    if (eeprom_open(dev) < 0)
+    {
+        free(dev);
+        remove(binary);
+        return -1;
+    }
+    start = eeprom_stats_now();
+    eeprom_write(dev, 0, sizeof(wbuf), wbuf);
+    within = eeprom_stats_now() - start;
+    usleep(2 * timing.write_cycle_us);
+    start = eeprom_stats_now();
+    eeprom_write(dev, bank - 512, sizeof(wbuf), wbuf);
+    across = eeprom_stats_now() - start;
+    eeprom_read(dev, bank - 512, sizeof(rbuf), rbuf);
+    if ((across < 3000ull * timing.write_cycle_us) || memcmp(wbuf, rbuf, sizeof(rbuf)))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+
+    //four stacked 64 KB chips: across two banks the second bank's
+    //pages go out while the first is in its write cycle
+    dev->properties.bank_size_words = bank;
+    if (eeprom_open(dev) < 0)
+    {
+        free(dev);
+        remove(binary);
+        return -1;
+    }
+    start = eeprom_stats_now();
+    eeprom_write(dev, 3 * bank - 512, sizeof(wbuf), wbuf);
+    across = eeprom_stats_now() - start;
+    eeprom_read(dev, 3 * bank - 512, sizeof(rbuf), rbuf);
+    if ((across >= within) || memcmp(wbuf, rbuf, sizeof(rbuf)))
+    {
+        result = -1;
+    }
+    eeprom_close(dev);
+    free(dev);
+    remove(binary);
+    return result;
+#endif
+}
+
+int main()
+{
+    int res = 0;
+
+    //Test simple write than read
+    printf("TEST 1: Write and Read Within Page\n");
+    res = test_1();
+    if (res == 1)
+    {
+        printf("test 1 succeeded\n");
+    }
+    else
+    {
+        printf("test 1 failed\n");
+    }
+
+    //Test write then read across page boundaries
+    printf("TEST 2: Write and Read Across Single Page Boundary\n");
+    res = 0;
+    res = test_2();
+    if (res == 1)
+    {
+        printf("test 2 succeeded\n");
+    }
+    else
+    {
+        printf("test 2 failed\n");
+    }
+
+    //Test write then read across multiple page boundaries
+    printf("TEST 3: Write and Read Across Multiple Page Boundaries\n");
+    res = 0;
+    res = test_3();
+    if (res == 1)
+    {
+        printf("test 3 succeeded\n");
+    }
+    else
+    {
+        printf("test 3 failed\n");
+    }
+
+    //Test write and read outside of eeprom boundaries
+    printf("TEST 4: Write and Read at EEPROM Boundary\n");
+    res = 0;
+    res = test_4();
+    if (res == 1)
+    {
+        printf("test 4 succeeded\n");
+    }
+    else
+    {
+        printf("test 4 failed\n");
+    }
+
+    //Test bad user input
+    printf("TEST 5: Bad User Input, should fail\n");
+    res = 0;
+    res = test_5();
+    if (res == 1)
+    {
+        printf("test 5 succeeded\n");
+    }
+    else
+    {
+        printf("test 5 failed\n");
+    }
+
+    printf("TEST 6: Multiple Writers and Multiple Readers\n");
+    //initialize device mutex
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    if (pthread_mutex_init(&eeprom_lock, &mattr) != 0)
+    {
+        printf("mutex init failed\n");
+        return -1;
+    }
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_t writer1, writer2, reader1, reader2; //thread ids
+    //two writer threads
+    pthread_create(&writer1, NULL, &p1_write_to_eeprom, NULL); //thread1
+    pthread_create(&writer2, NULL, &p2_write_to_eeprom, NULL); //thread2
+    //two reader threads
+    pthread_create(&reader1, NULL, &p3_read_from_eeprom, NULL); //thread3
+    pthread_create(&reader2, NULL, &p4_read_from_eeprom, NULL); //thread4
+    //start
+    pthread_join(writer1, NULL);
+    pthread_join(writer2, NULL);
+    pthread_join(reader1, NULL);
+    pthread_join(reader2, NULL);
+
+    //Test write then read through memory mapped device image
+    printf("TEST 7: Write and Read Through Mapped Device Image\n");
+    res = 0;
+    res = test_7();
+    if (res == 1)
+    {
+        printf("test 7 succeeded\n");
+    }
+    else
+    {
+        printf("test 7 failed\n");
+    }
+
+    //Test write-back cache and explicit flush
+    printf("TEST 8: Write-Back Cache Flush\n");
+    res = 0;
+    res = test_8();
+    if (res == 1)
+    {
+        printf("test 8 succeeded\n");
+    }
+    else
+    {
+        printf("test 8 failed\n");
+    }
+
+    //Test parallel readers, page-disjoint writers
+    printf("TEST 9: Striped Reader/Writer Page Locks\n");
+    res = 0;
+    res = test_9();
+    if (res == 1)
+    {
+        printf("test 9 succeeded\n");
+    }
+    else
+    {
+        printf("test 9 failed\n");
+    }
+
+    //Test asynchronous submission and completion
+    printf("TEST 10: Asynchronous Submission and Completion\n");
+    res = 0;
+    res = test_10();
+    if (res == 1)
+    {
+        printf("test 10 succeeded\n");
+    }
+    else
+    {
+        printf("test 10 failed\n");
+    }
+
+    //Test statistics counters
+    printf("TEST 11: Runtime Statistics\n");
+    res = 0;
+    res = test_11();
+    if (res == 1)
+    {
+        printf("test 11 succeeded\n");
+    }
+    else
+    {
+        printf("test 11 failed\n");
+    }
+
+    //Test binary image format
+    printf("TEST 12: Binary Device Image Format\n");
+    res = 0;
+    res = test_12();
+    if (res == 1)
+    {
+        printf("test 12 succeeded\n");
+    }
+    else
+    {
+        printf("test 12 failed\n");
+    }
+
+    //Test multiple devices with separate backing images
+    printf("TEST 13: Multiple Devices, Separate Images\n");
+    res = 0;
+    res = test_13();
+    if (res == 1)
+    {
+        printf("test 13 succeeded\n");
+    }
+    else
+    {
+        printf("test 13 failed\n");
+    }
+
+    //Test scatter-gather read and write
+    printf("TEST 14: Scatter-Gather Read/Write\n");
+    res = 0;
+    res = test_14();
+    if (res == 1)
+    {
+        printf("test 14 succeeded\n");
+    }
+    else
+    {
+        printf("test 14 failed\n");
+    }
+
+    //Test journaled multi-page writes
+    printf("TEST 15: Write-Ahead Journal Replay\n");
+    res = 0;
+    res = test_15();
+    if (res == 1)
+    {
+        printf("test 15 succeeded\n");
+    }
+    else
+    {
+        printf("test 15 failed\n");
+    }
+
+    //Test write elision
+    printf("TEST 16: Unchanged Page Write Elision\n");
+    res = 0;
+    res = test_16();
+    if (res == 1)
+    {
+        printf("test 16 succeeded\n");
+    }
+    else
+    {
+        printf("test 16 failed\n");
+    }
+
+    //Test I2C timing model
+    printf("TEST 17: Bus Timing and ACK Polling\n");
+    res = 0;
+    res = test_17();
+    if (res == 1)
+    {
+        printf("test 17 succeeded\n");
+    }
+    else
+    {
+        printf("test 17 failed\n");
+    }
+
+    //Test streaming cursor
+    printf("TEST 18: Streaming Read Cursor\n");
+    res = 0;
+    res = test_18();
+    if (res == 1)
+    {
+        printf("test 18 succeeded\n");
+    }
+    else
+    {
+        printf("test 18 failed\n");
+    }
+
+    //Test lock free reads over cache shadow
+    printf("TEST 19: Lock-Free Cached Reads\n");
+    res = 0;
+    res = test_19();
+    if (res == 1)
+    {
+        printf("test 19 succeeded\n");
+    }
+    else
+    {
+        printf("test 19 failed\n");
+    }
+
+    //Test batched writes
+    printf("TEST 20: Batched Write Commit\n");
+    res = 0;
+    res = test_20();
+    if (res == 1)
+    {
+        printf("test 20 succeeded\n");
+    }
+    else
+    {
+        printf("test 20 failed\n");
+    }
+
+    //Test write-coalescing scheduler
+    printf("TEST 21: Write-Coalescing Scheduler\n");
+    res = 0;
+    res = test_21();
+    if (res == 1)
+    {
+        printf("test 21 succeeded\n");
+    }
+    else
+    {
+        printf("test 21 failed\n");
+    }
+
+    printf("TEST 22: Page Checksum Verification\n");
+    res = 0;
+    res = test_22();
+    if (res == 1)
+    {
+        printf("test 22 succeeded\n");
+    }
+    else
+    {
+        printf("test 22 failed\n");
+    }
+
+    printf("TEST 23: Read-Only Mapping\n");
+    res = 0;
+    res = test_23();
+    if (res == 1)
+    {
+        printf("test 23 succeeded\n");
+    }
+    else
+    {
+        printf("test 23 failed\n");
+    }
+
+    printf("TEST 24: Transaction Retry Policy\n");
+    res = 0;
+    res = test_24();
+    if (res == 1)
+    {
+        printf("test 24 succeeded\n");
+    }
+    else
+    {
+        printf("test 24 failed\n");
+    }
+
+    printf("TEST 25: Shared Memory Driver State\n");
+    res = 0;
+    res = test_25();
+    if (res == 1)
+    {
+        printf("test 25 succeeded\n");
+    }
+    else
+    {
+        printf("test 25 failed\n");
+    }
+
+    printf("TEST 26: Backend Ops Table\n");
+    res = 0;
+    res = test_26();
+    if (res == 1)
+    {
+        printf("test 26 succeeded\n");
+    }
+    else
+    {
+        printf("test 26 failed\n");
+    }
+
+    printf("TEST 27: Part Table and Page Geometry\n");
+    res = 0;
+    res = test_27();
+    if (res == 1)
+    {
+        printf("test 27 succeeded\n");
+    }
+    else
+    {
+        printf("test 27 failed\n");
+    }
+
+    printf("TEST 28: Banked Devices Beyond 64 KB\n");
+    res = 0;
+    res = test_28();
+    if (res == 1)
+    {
+        printf("test 28 succeeded\n");
+    }
+    else
+    {
+        printf("test 28 failed\n");
+    }
 
     return 0;
 }